@@ -0,0 +1,116 @@
+#include <common/bench.h>
+#include <common/biased_counter.h>
+#include <common/packed_counter.h>
+#include <common/sharded_counter.h>
+#include <intrusive/intrusive.h>
+#include <weak/shared.h>
+#include <weak/weak.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+// Worst case for the reference counts: every thread hammers the counters of one object.
+// For each counter strategy, threads pinned to their own cores either copy and drop one
+// `SharedPtr`, `Lock` one `WeakPtr`, or copy and drop one `IntrusivePtr`, for every thread
+// count from 1 to the number of hardware threads. Prints the throughput and the speedup
+// over one thread; a speedup that stops growing marks the point where the cache line of the
+// counters saturates.
+
+namespace {
+
+constexpr std::chrono::milliseconds kDuration{200};
+
+template <typename Counter>
+struct Object : public RefCounted<Object<Counter>, Counter, DefaultDelete> {
+    int value = 42;
+};
+
+template <typename Counter>
+double CopyShared(size_t num_threads) {
+    auto global = MakeShared<int, Counter>(42);
+    return MeasureThroughput(num_threads, kDuration,
+                             [&](size_t index, const std::atomic<bool>& stop) {
+                                 PinToCore(index);
+                                 uint64_t ops = 0;
+                                 while (!stop.load(std::memory_order_relaxed)) {
+                                     SharedPtr<int, Counter> copy = global;
+                                     DoNotOptimize(*copy);
+                                     ++ops;
+                                 }
+                                 return ops;
+                             });
+}
+
+template <typename Counter>
+double LockWeak(size_t num_threads) {
+    auto owner = MakeShared<int, Counter>(42);
+    WeakPtr<int, Counter> global(owner);
+    return MeasureThroughput(num_threads, kDuration,
+                             [&](size_t index, const std::atomic<bool>& stop) {
+                                 PinToCore(index);
+                                 uint64_t ops = 0;
+                                 while (!stop.load(std::memory_order_relaxed)) {
+                                     SharedPtr<int, Counter> locked = global.Lock();
+                                     DoNotOptimize(*locked);
+                                     ++ops;
+                                 }
+                                 return ops;
+                             });
+}
+
+template <typename Counter>
+double CopyIntrusive(size_t num_threads) {
+    IntrusivePtr<Object<Counter>> global(new Object<Counter>);
+    return MeasureThroughput(num_threads, kDuration,
+                             [&](size_t index, const std::atomic<bool>& stop) {
+                                 PinToCore(index);
+                                 uint64_t ops = 0;
+                                 while (!stop.load(std::memory_order_relaxed)) {
+                                     IntrusivePtr<Object<Counter>> copy = global;
+                                     DoNotOptimize(copy->value);
+                                     ++ops;
+                                 }
+                                 return ops;
+                             });
+}
+
+// Ops/s for each thread count from 1 to `max_threads`.
+template <typename Run>
+void Sweep(const char* scenario, const char* counter, size_t max_threads, Run run) {
+    double single = 0;
+    for (size_t num_threads = 1; num_threads <= max_threads; ++num_threads) {
+        double ops = run(num_threads);
+        if (num_threads == 1) {
+            single = ops;
+        }
+        std::printf("%-14s %-22s %8zu %16.2f %10.2f\n", scenario, counter, num_threads,
+                    ops / 1e6, ops / single);
+    }
+}
+
+}  // namespace
+
+int main() {
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::printf("%-14s %-22s %8s %16s %10s\n", "scenario", "counter", "threads", "Mops/s",
+                "speedup");
+
+    Sweep("SharedPtr copy", "AtomicCounter", max_threads, CopyShared<AtomicCounter>);
+    Sweep("SharedPtr copy", "PackedCounter", max_threads, CopyShared<PackedCounter>);
+    Sweep("SharedPtr copy", "BiasedCounter", max_threads, CopyShared<BiasedCounter>);
+    Sweep("SharedPtr copy", "AtomicSaturating<u32>", max_threads,
+          CopyShared<AtomicSaturatingCounter<uint32_t>>);
+
+    Sweep("WeakPtr Lock", "AtomicCounter", max_threads, LockWeak<AtomicCounter>);
+    Sweep("WeakPtr Lock", "PackedCounter", max_threads, LockWeak<PackedCounter>);
+    Sweep("WeakPtr Lock", "BiasedCounter", max_threads, LockWeak<BiasedCounter>);
+    Sweep("WeakPtr Lock", "AtomicSaturating<u32>", max_threads,
+          LockWeak<AtomicSaturatingCounter<uint32_t>>);
+
+    Sweep("Intrusive copy", "AtomicCounter", max_threads, CopyIntrusive<AtomicCounter>);
+    Sweep("Intrusive copy", "ShardedCounter", max_threads, CopyIntrusive<ShardedCounter<>>);
+    Sweep("Intrusive copy", "AtomicSaturating<u32>", max_threads,
+          CopyIntrusive<AtomicSaturatingCounter<uint32_t>>);
+}
@@ -0,0 +1,253 @@
+#include <common/bench.h>
+#include <intrusive/intrusive.h>
+#include <unique/unique.h>
+#include <weak/shared.h>
+
+#include <malloc.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Traversal of large pointer graphs with each ownership model: `SharedPtr` from `new` (node and
+// `PointingControlBlock` are separate allocations), `MakeShared` (node inside the
+// `EmplacingControlBlock`), `IntrusivePtr` (counter inside the node) and `UniquePtr` as the
+// baseline without a counter. Three shapes: a linked list, a complete binary tree and a DAG laid
+// out like Pascal's triangle, where node j of a layer owns nodes j and j + 1 of the next one, so
+// every inner node has two owners (`UniquePtr` cannot express it). Nodes are allocated in one go
+// and linked either in allocation order or in a random order, so that every step of a shuffled
+// graph misses the cache.
+//
+// Graphs are walked depth-first with an explicit stack. "read" follows `Get()` and touches only
+// the nodes. "copy" holds owning pointers on the stack, the way an iterator holding a
+// `SharedPtr` does, so every step also writes the counters of the nodes. The DAG walk marks
+// visited nodes to reach each one once. Resident memory per node is the growth of the RSS while
+// the graph is built.
+
+namespace {
+
+constexpr size_t kNumNodes = size_t{1} << 20;
+constexpr int kRounds = 5;
+
+enum class Shape { kList, kTree, kDag };
+
+const char* ShapeName(Shape shape) {
+    switch (shape) {
+        case Shape::kList:
+            return "list";
+        case Shape::kTree:
+            return "tree";
+        case Shape::kDag:
+            return "dag";
+    }
+    return "";
+}
+
+struct SharedNode {
+    SharedPtr<SharedNode> left;
+    SharedPtr<SharedNode> right;
+    int64_t value = 1;
+    int64_t visited = 0;
+};
+
+struct IntrusiveNode : public SimpleRefCounted<IntrusiveNode> {
+    IntrusivePtr<IntrusiveNode> left;
+    IntrusivePtr<IntrusiveNode> right;
+    int64_t value = 1;
+    int64_t visited = 0;
+};
+
+struct UniqueNode {
+    UniquePtr<UniqueNode> left;
+    UniquePtr<UniqueNode> right;
+    int64_t value = 1;
+    int64_t visited = 0;
+};
+
+size_t ResidentBytes() {
+    size_t total_pages = 0;
+    size_t resident_pages = 0;
+    if (FILE* statm = std::fopen("/proc/self/statm", "r")) {
+        if (std::fscanf(statm, "%zu %zu", &total_pages, &resident_pages) != 2) {
+            resident_pages = 0;
+        }
+        std::fclose(statm);
+    }
+    return resident_pages * sysconf(_SC_PAGESIZE);
+}
+
+// Positions of the children of the node at `position`, `kNumNodes` where there is none. `layer`
+// is the layer of `position` in the DAG, `BuildGraph` advances it.
+std::pair<size_t, size_t> Children(Shape shape, size_t position, size_t layer) {
+    switch (shape) {
+        case Shape::kList:
+            return {position + 1, kNumNodes};
+        case Shape::kTree:
+            return {2 * position + 1, 2 * position + 2};
+        case Shape::kDag:
+            return {position + layer + 1, position + layer + 2};
+    }
+    return {kNumNodes, kNumNodes};
+}
+
+// Allocates `kNumNodes` nodes with `make` in order, then places them at the positions of `shape`
+// in allocation order or in a random one. Returns the root.
+template <typename Make>
+auto BuildGraph(Make make, Shape shape, bool shuffled) {
+    using Ptr = decltype(make());
+    std::vector<Ptr> owners;
+    owners.reserve(kNumNodes);
+    std::vector<decltype(owners[0].Get())> nodes;
+    nodes.reserve(kNumNodes);
+    for (size_t i = 0; i < kNumNodes; ++i) {
+        owners.push_back(make());
+        nodes.push_back(owners.back().Get());
+    }
+
+    std::vector<size_t> order(kNumNodes);
+    std::iota(order.begin(), order.end(), 0);
+    if (shuffled) {
+        std::shuffle(order.begin(), order.end(), std::mt19937_64(42));
+    }
+    auto link = [&](Ptr& child, size_t position) {
+        if (position >= kNumNodes) {
+            return;
+        }
+        // In the DAG a node has two owners; elsewhere it has one and the move leaves nothing
+        // behind in `owners`.
+        if constexpr (std::is_copy_constructible_v<Ptr>) {
+            child = owners[order[position]];
+        } else {
+            child = std::move(owners[order[position]]);
+        }
+    };
+    for (size_t position = 0, layer = 0, layer_end = 1; position < kNumNodes; ++position) {
+        if (position == layer_end) {
+            ++layer;
+            layer_end += layer + 1;
+        }
+        auto [left, right] = Children(shape, position, layer);
+        auto* node = nodes[order[position]];
+        link(node->left, left);
+        link(node->right, right);
+    }
+    return std::move(owners[order[0]]);
+}
+
+// Iterative along `left`: a recursive destruction of a list this long overflows the stack. The
+// tree and the DAG are shallow enough for the recursion through `right`.
+template <typename Ptr>
+void DestroyGraph(Ptr& root) {
+    while (root) {
+        Ptr left = std::move(root->left);
+        root = std::move(left);
+    }
+}
+
+template <typename Ptr>
+double NsPerNode(const Ptr& root, Shape shape, bool copying) {
+    using Node = std::remove_pointer_t<decltype(root.Get())>;
+    std::vector<Node*> stack;
+    std::vector<Ptr> owning_stack;
+    std::chrono::duration<double, std::nano> total{0};
+    for (int round = 1; round <= kRounds; ++round) {
+        int64_t sum = 0;
+        auto begin = std::chrono::steady_clock::now();
+        // Marks `child` and returns true if the walk has not reached it yet.
+        auto first_visit = [&](Node* child) {
+            if (!child) {
+                return false;
+            }
+            if (shape == Shape::kDag) {
+                if (child->visited == round) {
+                    return false;
+                }
+                child->visited = round;
+            }
+            return true;
+        };
+        if constexpr (std::is_copy_constructible_v<Ptr>) {
+            if (copying) {
+                first_visit(root.Get());
+                owning_stack.push_back(root);
+                while (!owning_stack.empty()) {
+                    Ptr node = std::move(owning_stack.back());
+                    owning_stack.pop_back();
+                    sum += node->value;
+                    if (first_visit(node->right.Get())) {
+                        owning_stack.push_back(node->right);
+                    }
+                    if (first_visit(node->left.Get())) {
+                        owning_stack.push_back(node->left);
+                    }
+                }
+            }
+        }
+        if (!copying) {
+            first_visit(root.Get());
+            stack.push_back(root.Get());
+            while (!stack.empty()) {
+                Node* node = stack.back();
+                stack.pop_back();
+                sum += node->value;
+                if (first_visit(node->right.Get())) {
+                    stack.push_back(node->right.Get());
+                }
+                if (first_visit(node->left.Get())) {
+                    stack.push_back(node->left.Get());
+                }
+            }
+        }
+        total += std::chrono::steady_clock::now() - begin;
+        DoNotOptimize(sum);
+    }
+    return total.count() / (kRounds * kNumNodes);
+}
+
+template <typename Make>
+void Report(const char* model, Make make) {
+    using Ptr = decltype(make());
+    for (Shape shape : {Shape::kList, Shape::kTree, Shape::kDag}) {
+        if (shape == Shape::kDag && !std::is_copy_constructible_v<Ptr>) {
+            continue;
+        }
+        for (bool shuffled : {false, true}) {
+            malloc_trim(0);
+            size_t before = ResidentBytes();
+            Ptr root = BuildGraph(make, shape, shuffled);
+            // Returns the temporary vectors of `BuildGraph` to the system.
+            malloc_trim(0);
+            double bytes_per_node = static_cast<double>(ResidentBytes() - before) / kNumNodes;
+
+            double read_ns = NsPerNode(root, shape, false);
+            std::printf("%-16s %-5s %-11s %12.2f", model, ShapeName(shape),
+                        shuffled ? "shuffled" : "sequential", read_ns);
+            if constexpr (std::is_copy_constructible_v<Ptr>) {
+                std::printf(" %12.2f", NsPerNode(root, shape, true));
+            } else {
+                std::printf(" %12s", "-");
+            }
+            std::printf(" %14.1f\n", bytes_per_node);
+            DestroyGraph(root);
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    std::printf("%zu nodes\n", kNumNodes);
+    std::printf("%-16s %-5s %-11s %12s %12s %14s\n", "model", "shape", "order", "read (ns)",
+                "copy (ns)", "RSS/node (B)");
+    Report("UniquePtr", [] { return UniquePtr<UniqueNode>(new UniqueNode); });
+    Report("SharedPtr(new)", [] { return SharedPtr<SharedNode>(new SharedNode); });
+    Report("MakeShared", [] { return MakeShared<SharedNode>(); });
+    Report("IntrusivePtr", [] { return MakeIntrusive<IntrusiveNode>(); });
+}
@@ -0,0 +1,205 @@
+#include <common/alloc_profiler.h>
+#include <common/bench.h>
+#include <intrusive/intrusive.h>
+#include <unique/unique.h>
+#include <weak/shared.h>
+#include <weak/weak.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Single-threaded cost of the basic operations of every pointer type against the standard
+// library and raw pointers, for several payload sizes. Prints one JSON document:
+//
+//   {"benchmarks": [{"operation": "copy", "pointer": "SharedPtr", "payload": 64,
+//                    "ns_per_op": 3.1, "allocs_per_op": 0}, ...]}
+//
+// so that runs of two versions can be diffed. Allocations are counted by `alloc_profiler`.
+
+namespace {
+
+template <size_t Size>
+struct Payload {
+    char data[Size] = {};
+};
+
+template <size_t Size>
+struct IntrusivePayload : SimpleRefCounted<IntrusivePayload<Size>> {
+    char data[Size] = {};
+};
+
+constexpr int kIters = 1'000'000;
+
+struct Result {
+    std::string operation;
+    std::string pointer;
+    size_t payload;
+    double ns_per_op;
+    double allocs_per_op;
+};
+
+std::vector<Result> results;
+
+// Runs `body` `kIters` times.
+template <typename F>
+void Measure(const char* operation, const char* pointer, size_t payload, F body) {
+    for (int i = 0; i < kIters / 10; ++i) {
+        body();
+    }
+    alloc_profiler::AllocationScope scope;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIters; ++i) {
+        body();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+    uint64_t allocations = scope.Stats().allocations;
+    results.push_back({operation, pointer, payload, elapsed.count() / kIters,
+                       static_cast<double>(allocations) / kIters});
+}
+
+template <size_t Size>
+void RunConstruction() {
+    using T = Payload<Size>;
+    using I = IntrusivePayload<Size>;
+
+    Measure("construct", "raw", Size, [] {
+        T* ptr = new T;
+        DoNotOptimize(ptr);
+        delete ptr;
+    });
+    Measure("construct", "UniquePtr", Size, [] { DoNotOptimize(UniquePtr<T>(new T).Get()); });
+    Measure("construct", "std::unique_ptr", Size,
+            [] { DoNotOptimize(std::unique_ptr<T>(new T).get()); });
+    Measure("construct", "SharedPtr", Size, [] { DoNotOptimize(SharedPtr<T>(new T).Get()); });
+    Measure("construct", "std::shared_ptr", Size,
+            [] { DoNotOptimize(std::shared_ptr<T>(new T).get()); });
+    Measure("construct", "IntrusivePtr", Size,
+            [] { DoNotOptimize(IntrusivePtr<I>(new I).Get()); });
+
+    Measure("make", "SharedPtr", Size, [] { DoNotOptimize(MakeShared<T>().Get()); });
+    Measure("make", "std::shared_ptr", Size,
+            [] { DoNotOptimize(std::make_shared<T>().get()); });
+    Measure("make", "IntrusivePtr", Size, [] { DoNotOptimize(MakeIntrusive<I>().Get()); });
+    Measure("make", "std::unique_ptr", Size,
+            [] { DoNotOptimize(std::make_unique<T>().get()); });
+}
+
+template <size_t Size>
+void RunCopies() {
+    using T = Payload<Size>;
+    using I = IntrusivePayload<Size>;
+
+    T* raw = new T;
+    Measure("copy", "raw", Size, [raw] {
+        T* copy = raw;
+        DoNotOptimize(copy);
+    });
+    delete raw;
+
+    auto shared = MakeShared<T>();
+    Measure("copy", "SharedPtr", Size, [&] {
+        SharedPtr<T> copy = shared;
+        DoNotOptimize(copy.Get());
+    });
+    auto std_shared = std::make_shared<T>();
+    Measure("copy", "std::shared_ptr", Size, [&] {
+        std::shared_ptr<T> copy = std_shared;
+        DoNotOptimize(copy.get());
+    });
+    auto intrusive = MakeIntrusive<I>();
+    Measure("copy", "IntrusivePtr", Size, [&] {
+        IntrusivePtr<I> copy = intrusive;
+        DoNotOptimize(copy.Get());
+    });
+
+    WeakPtr<T> weak(shared);
+    Measure("lock", "WeakPtr", Size, [&] { DoNotOptimize(weak.Lock().Get()); });
+    std::weak_ptr<T> std_weak(std_shared);
+    Measure("lock", "std::weak_ptr", Size, [&] { DoNotOptimize(std_weak.lock().get()); });
+}
+
+// Moves a pointer to another and back.
+template <typename Ptr>
+void MeasureMove(const char* pointer, size_t payload, Ptr ptr) {
+    Ptr other;
+    Measure("move", pointer, payload, [&] {
+        other = std::move(ptr);
+        ptr = std::move(other);
+        DoNotOptimize(ptr);
+    });
+}
+
+template <typename Ptr>
+void MeasureSwap(const char* pointer, size_t payload, Ptr first, Ptr second) {
+    Measure("swap", pointer, payload, [&] {
+        first.Swap(second);
+        DoNotOptimize(first);
+    });
+}
+
+template <size_t Size>
+void RunMovesAndResets() {
+    using T = Payload<Size>;
+    using I = IntrusivePayload<Size>;
+
+    MeasureMove("UniquePtr", Size, UniquePtr<T>(new T));
+    MeasureMove("std::unique_ptr", Size, std::make_unique<T>());
+    MeasureMove("SharedPtr", Size, MakeShared<T>());
+    MeasureMove("std::shared_ptr", Size, std::make_shared<T>());
+    MeasureMove("IntrusivePtr", Size, MakeIntrusive<I>());
+
+    MeasureSwap("UniquePtr", Size, UniquePtr<T>(new T), UniquePtr<T>(new T));
+    MeasureSwap("SharedPtr", Size, MakeShared<T>(), MakeShared<T>());
+    MeasureSwap("IntrusivePtr", Size, MakeIntrusive<I>(), MakeIntrusive<I>());
+    {
+        auto first = std::make_shared<T>();
+        auto second = std::make_shared<T>();
+        Measure("swap", "std::shared_ptr", Size, [&] {
+            first.swap(second);
+            DoNotOptimize(first);
+        });
+    }
+
+    // Replaces the object: one object freed and one allocated per operation.
+    UniquePtr<T> unique(new T);
+    Measure("reset", "UniquePtr", Size, [&] { unique.Reset(new T); });
+    std::unique_ptr<T> std_unique(new T);
+    Measure("reset", "std::unique_ptr", Size, [&] { std_unique.reset(new T); });
+    SharedPtr<T> shared(new T);
+    Measure("reset", "SharedPtr", Size, [&] { shared.Reset(new T); });
+    std::shared_ptr<T> std_shared(new T);
+    Measure("reset", "std::shared_ptr", Size, [&] { std_shared.reset(new T); });
+    IntrusivePtr<I> intrusive(new I);
+    Measure("reset", "IntrusivePtr", Size, [&] { intrusive.Reset(new I); });
+}
+
+template <size_t Size>
+void RunAll() {
+    RunConstruction<Size>();
+    RunCopies<Size>();
+    RunMovesAndResets<Size>();
+}
+
+}  // namespace
+
+int main() {
+    RunAll<8>();
+    RunAll<64>();
+    RunAll<1024>();
+
+    std::printf("{\"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        std::printf("  {\"operation\": \"%s\", \"pointer\": \"%s\", \"payload\": %zu, "
+                    "\"ns_per_op\": %.2f, \"allocs_per_op\": %.2f}%s\n",
+                    result.operation.c_str(), result.pointer.c_str(), result.payload,
+                    result.ns_per_op, result.allocs_per_op, i + 1 < results.size() ? "," : "");
+    }
+    std::printf("]}\n");
+}
@@ -0,0 +1,367 @@
+#include "alloc_profiler.h"
+
+#include <malloc.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+namespace alloc_profiler {
+
+namespace {
+
+// Trivial, so that `operator new` can use it before any constructor runs and after every
+// destructor has run. Only the owning thread writes, through `Store`, so that the summary can
+// read the counters of other threads.
+struct Counters {
+    uint64_t allocations;
+    uint64_t deallocations;
+    uint64_t allocated_bytes;
+    uint64_t freed_bytes;
+    int64_t live_bytes;
+    int64_t peak_live_bytes;
+    uint64_t size_classes[kNumSizeClasses];
+};
+
+struct AtomicCounters {
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> deallocations;
+    std::atomic<uint64_t> allocated_bytes;
+    std::atomic<uint64_t> freed_bytes;
+    std::atomic<int64_t> live_bytes;
+    std::atomic<int64_t> peak_live_bytes;
+    std::atomic<uint64_t> size_classes[kNumSizeClasses];
+};
+
+constinit AtomicCounters global_counters{};
+
+// The counters of one thread. Allocated with `malloc` and never freed: the summary at exit
+// reports the threads that exited too.
+struct ThreadRecord {
+    Counters counters;
+    uint64_t number;
+    std::atomic<bool> exited;
+    ThreadRecord* next;
+};
+
+constinit std::mutex threads_mutex;
+constinit ThreadRecord* threads = nullptr;
+constinit uint64_t num_threads = 0;
+
+constinit thread_local ThreadRecord* thread_record = nullptr;
+// No allocation counted by a thread is lost, but the zeros of a thread that never allocated
+// need not be registered.
+constinit thread_local Counters no_counters{};
+
+// Marks the record of the thread when it exits. The main thread is still running when the
+// summary is written.
+struct ExitMarker {
+    ~ExitMarker() {
+        if (gettid() != getpid()) {
+            thread_record->exited.store(true, std::memory_order_relaxed);
+        }
+    }
+};
+
+template <typename T>
+void Store(T& field, T value) {
+    std::atomic_ref<T>(field).store(value, std::memory_order_relaxed);
+}
+
+template <typename T>
+T Load(T& field) {
+    return std::atomic_ref<T>(field).load(std::memory_order_relaxed);
+}
+
+Counters& LocalCounters() {
+    if (!thread_record) [[unlikely]] {
+        auto record = static_cast<ThreadRecord*>(std::calloc(1, sizeof(ThreadRecord)));
+        if (!record) {
+            return no_counters;
+        }
+        {
+            std::lock_guard lock(threads_mutex);
+            record->number = ++num_threads;
+            record->next = threads;
+            threads = record;
+        }
+        thread_record = record;
+        static thread_local ExitMarker exit_marker;
+    }
+    return thread_record->counters;
+}
+
+const Counters& LocalCountersOrZero() {
+    return thread_record ? thread_record->counters : no_counters;
+}
+
+size_t SizeClass(size_t size) {
+    return size <= 1 ? 0 : std::min<size_t>(std::bit_width(size - 1), kNumSizeClasses - 1);
+}
+
+void RecordAllocation(size_t size, size_t reserved) {
+    Counters& local = LocalCounters();
+    Store(local.allocations, local.allocations + 1);
+    Store(local.allocated_bytes, local.allocated_bytes + reserved);
+    Store(local.live_bytes, local.live_bytes + static_cast<int64_t>(reserved));
+    Store(local.peak_live_bytes, std::max(local.peak_live_bytes, local.live_bytes));
+    Store(local.size_classes[SizeClass(size)], local.size_classes[SizeClass(size)] + 1);
+
+    global_counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    global_counters.allocated_bytes.fetch_add(reserved, std::memory_order_relaxed);
+    global_counters.size_classes[SizeClass(size)].fetch_add(1, std::memory_order_relaxed);
+    int64_t live = global_counters.live_bytes.fetch_add(reserved, std::memory_order_relaxed) +
+                   static_cast<int64_t>(reserved);
+    int64_t peak = global_counters.peak_live_bytes.load(std::memory_order_relaxed);
+    while (peak < live && !global_counters.peak_live_bytes.compare_exchange_weak(
+                              peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void RecordDeallocation(size_t reserved) {
+    Counters& local = LocalCounters();
+    Store(local.deallocations, local.deallocations + 1);
+    Store(local.freed_bytes, local.freed_bytes + reserved);
+    Store(local.live_bytes, local.live_bytes - static_cast<int64_t>(reserved));
+
+    global_counters.deallocations.fetch_add(1, std::memory_order_relaxed);
+    global_counters.freed_bytes.fetch_add(reserved, std::memory_order_relaxed);
+    global_counters.live_bytes.fetch_sub(reserved, std::memory_order_relaxed);
+}
+
+void* Allocate(size_t size, size_t alignment) {
+    void* ptr = nullptr;
+    if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        ptr = std::malloc(size ? size : 1);
+    } else if (posix_memalign(&ptr, alignment, size ? size : 1) != 0) {
+        ptr = nullptr;
+    }
+    if (ptr) {
+        RecordAllocation(size, malloc_usable_size(ptr));
+    }
+    return ptr;
+}
+
+// As the standard `operator new`: calls the new-handler until the allocation succeeds, throws
+// if there is none.
+void* AllocateOrThrow(size_t size, size_t alignment) {
+    void* ptr;
+    while (!(ptr = Allocate(size, alignment))) {
+        if (std::new_handler handler = std::get_new_handler()) {
+            handler();
+        } else {
+            throw std::bad_alloc();
+        }
+    }
+    return ptr;
+}
+
+void* AllocateOrNull(size_t size, size_t alignment) noexcept {
+    try {
+        return AllocateOrThrow(size, alignment);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void Deallocate(void* ptr) {
+    if (ptr) {
+        RecordDeallocation(malloc_usable_size(ptr));
+        std::free(ptr);
+    }
+}
+
+// Also for the counters of other threads.
+AllocationStats ToStats(const Counters& counters) {
+    auto& shared = const_cast<Counters&>(counters);
+    AllocationStats stats;
+    stats.allocations = Load(shared.allocations);
+    stats.deallocations = Load(shared.deallocations);
+    stats.allocated_bytes = Load(shared.allocated_bytes);
+    stats.freed_bytes = Load(shared.freed_bytes);
+    stats.peak_live_bytes = Load(shared.peak_live_bytes);
+    for (size_t i = 0; i < kNumSizeClasses; ++i) {
+        stats.size_classes[i] = Load(shared.size_classes[i]);
+    }
+    return stats;
+}
+
+void PrintSummary(FILE* out) {
+    std::fprintf(out, "process\n");
+    PrintStats(out, GlobalStats());
+    for (const ThreadInfo& thread : AllThreadStats()) {
+        std::fprintf(out, "\nthread %llu%s\n", static_cast<unsigned long long>(thread.number),
+                     thread.exited ? " (exited)" : "");
+        PrintStats(out, thread.stats);
+    }
+}
+
+struct SummaryAtExit {
+    ~SummaryAtExit() {
+        const char* path = std::getenv("ALLOC_PROFILER_SUMMARY");
+        if (!path) {
+            return;
+        }
+        if (path[0] == '-' && path[1] == '\0') {
+            PrintSummary(stderr);
+        } else if (FILE* out = std::fopen(path, "w")) {
+            PrintSummary(out);
+            std::fclose(out);
+        }
+    }
+} summary_at_exit;
+
+}  // namespace
+
+AllocationStats GlobalStats() {
+    AllocationStats stats;
+    stats.allocations = global_counters.allocations.load(std::memory_order_relaxed);
+    stats.deallocations = global_counters.deallocations.load(std::memory_order_relaxed);
+    stats.allocated_bytes = global_counters.allocated_bytes.load(std::memory_order_relaxed);
+    stats.freed_bytes = global_counters.freed_bytes.load(std::memory_order_relaxed);
+    stats.peak_live_bytes = global_counters.peak_live_bytes.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < kNumSizeClasses; ++i) {
+        stats.size_classes[i] = global_counters.size_classes[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+AllocationStats ThreadStats() {
+    return ToStats(LocalCountersOrZero());
+}
+
+std::vector<ThreadInfo> AllThreadStats() {
+    std::vector<ThreadInfo> result;
+    {
+        std::lock_guard lock(threads_mutex);
+        for (ThreadRecord* record = threads; record; record = record->next) {
+            result.push_back({record->number, record->exited.load(std::memory_order_relaxed),
+                              ToStats(record->counters)});
+        }
+    }
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+// The thread's peak restarts at the current live bytes, and goes back to the larger of both
+// peaks when the scope ends, so that enclosing scopes still see it.
+AllocationScope::AllocationScope() : begin_(ThreadStats()) {
+    Counters& local = LocalCounters();
+    outer_peak_ = local.peak_live_bytes;
+    Store(local.peak_live_bytes, local.live_bytes);
+}
+
+AllocationScope::~AllocationScope() {
+    Counters& local = LocalCounters();
+    Store(local.peak_live_bytes, std::max(outer_peak_, local.peak_live_bytes));
+}
+
+AllocationStats AllocationScope::Stats() const {
+    AllocationStats now = ThreadStats();
+    AllocationStats stats;
+    stats.allocations = now.allocations - begin_.allocations;
+    stats.deallocations = now.deallocations - begin_.deallocations;
+    stats.allocated_bytes = now.allocated_bytes - begin_.allocated_bytes;
+    stats.freed_bytes = now.freed_bytes - begin_.freed_bytes;
+    stats.peak_live_bytes = now.peak_live_bytes - begin_.LiveBytes();
+    for (size_t i = 0; i < kNumSizeClasses; ++i) {
+        stats.size_classes[i] = now.size_classes[i] - begin_.size_classes[i];
+    }
+    return stats;
+}
+
+void PrintStats(FILE* out, const AllocationStats& stats) {
+    std::fprintf(out, "allocations      %llu\n", static_cast<unsigned long long>(stats.allocations));
+    std::fprintf(out, "deallocations    %llu\n",
+                 static_cast<unsigned long long>(stats.deallocations));
+    std::fprintf(out, "allocated bytes  %llu\n",
+                 static_cast<unsigned long long>(stats.allocated_bytes));
+    std::fprintf(out, "freed bytes      %llu\n", static_cast<unsigned long long>(stats.freed_bytes));
+    std::fprintf(out, "live bytes       %lld\n", static_cast<long long>(stats.LiveBytes()));
+    std::fprintf(out, "peak live bytes  %lld\n", static_cast<long long>(stats.peak_live_bytes));
+    std::fprintf(out, "%-16s %s\n", "size class", "allocations");
+    for (size_t i = 0; i < kNumSizeClasses; ++i) {
+        if (stats.size_classes[i] == 0) {
+            continue;
+        }
+        if (i + 1 < kNumSizeClasses) {
+            std::fprintf(out, "<= %-13zu %llu\n", size_t{1} << i,
+                         static_cast<unsigned long long>(stats.size_classes[i]));
+        } else {
+            std::fprintf(out, "> %-14zu %llu\n", size_t{1} << (i - 1),
+                         static_cast<unsigned long long>(stats.size_classes[i]));
+        }
+    }
+}
+
+}  // namespace alloc_profiler
+
+using alloc_profiler::AllocateOrNull;
+using alloc_profiler::AllocateOrThrow;
+using alloc_profiler::Deallocate;
+
+void* operator new(size_t size) {
+    return AllocateOrThrow(size, 0);
+}
+void* operator new[](size_t size) {
+    return AllocateOrThrow(size, 0);
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return AllocateOrNull(size, 0);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return AllocateOrNull(size, 0);
+}
+void* operator new(size_t size, std::align_val_t alignment) {
+    return AllocateOrThrow(size, static_cast<size_t>(alignment));
+}
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return AllocateOrThrow(size, static_cast<size_t>(alignment));
+}
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateOrNull(size, static_cast<size_t>(alignment));
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return AllocateOrNull(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept {
+    Deallocate(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+    Deallocate(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept {
+    Deallocate(ptr);
+}
+void operator delete[](void* ptr, size_t) noexcept {
+    Deallocate(ptr);
+}
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    Deallocate(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    Deallocate(ptr);
+}
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    Deallocate(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    Deallocate(ptr);
+}
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    Deallocate(ptr);
+}
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+    Deallocate(ptr);
+}
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    Deallocate(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    Deallocate(ptr);
+}
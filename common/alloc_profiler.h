@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Heap profiling for tests and benchmarks. Linking the `alloc_profiler` library replaces the
+// global `operator new`/`operator delete` (every variant, aligned and nothrow included) with
+// versions that count allocations, bytes and size classes for the whole process and for each
+// thread, the threads that exited included. `AllocationScope` reports what the current thread did while it was alive, e.g. to
+// check that a steady-state loop over `SharedPtr` copies does not allocate:
+//
+//     alloc_profiler::AllocationScope scope;
+//     for (...) { ... }
+//     assert(scope.Stats().allocations == 0);
+//
+// Setting `ALLOC_PROFILER_SUMMARY` to a file name (or to "-" for stderr) writes the process
+// totals and those of every thread there at exit. Failed allocations call the new-handler as
+// the standard `operator new` does. Bytes are counted as reserved by `malloc`, see `malloc_usable_size`.
+// Linux only.
+
+namespace alloc_profiler {
+
+// Size class `i` counts allocations of more than 2^(i-1) and at most 2^i bytes, the last one
+// everything larger.
+inline constexpr size_t kNumSizeClasses = 24;
+
+struct AllocationStats {
+    uint64_t allocations = 0;
+    uint64_t deallocations = 0;
+    uint64_t allocated_bytes = 0;
+    uint64_t freed_bytes = 0;
+    // Highest excess of allocated over freed bytes, counted from the start of the period.
+    int64_t peak_live_bytes = 0;
+    std::array<uint64_t, kNumSizeClasses> size_classes{};
+
+    int64_t LiveBytes() const {
+        return static_cast<int64_t>(allocated_bytes - freed_bytes);
+    }
+};
+
+// Since the start of the process.
+AllocationStats GlobalStats();
+// Since the start of the calling thread.
+AllocationStats ThreadStats();
+
+struct ThreadInfo {
+    // In the order of the first allocation of each thread, from 1.
+    uint64_t number;
+    bool exited;
+    AllocationStats stats;
+};
+
+// Every thread that allocated so far, the ones that exited included.
+std::vector<ThreadInfo> AllThreadStats();
+
+// Allocations made and freed by the calling thread during the lifetime of the scope. Scopes
+// nest; memory allocated before the scope and freed inside counts as a deallocation.
+class AllocationScope {
+public:
+    AllocationScope();
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+    ~AllocationScope();
+
+    AllocationStats Stats() const;
+
+private:
+    AllocationStats begin_;
+    int64_t outer_peak_;
+};
+
+void PrintStats(FILE* out, const AllocationStats& stats);
+
+}  // namespace alloc_profiler
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Helpers shared by the bench_* targets.
+
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// 1, 2, 4, ... up to and including the number of hardware threads.
+inline std::vector<size_t> ThreadCounts() {
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> counts;
+    for (size_t count = 1; count < max_threads; count *= 2) {
+        counts.push_back(count);
+    }
+    counts.push_back(max_threads);
+    return counts;
+}
+
+// Pins the calling thread to core `index` modulo the number of cores, so that threads with
+// different indices run on different cores when there are enough of them. Linux only.
+inline void PinToCore(size_t index) {
+    size_t num_cores = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(index % num_cores, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+// Runs `body(thread_index, stop)` on `num_threads` threads for `duration` and returns the
+// total number of operations per second. `body` loops until `stop` is set and returns how
+// many operations it did.
+template <typename F>
+double MeasureThroughput(size_t num_threads, std::chrono::milliseconds duration, F body) {
+    std::atomic<size_t> ready = 0;
+    std::atomic<bool> start = false;
+    std::atomic<bool> stop = false;
+    std::atomic<uint64_t> total = 0;
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&, i] {
+            ++ready;
+            while (!start.load(std::memory_order_acquire)) {
+            }
+            total += body(i, stop);
+        });
+    }
+    while (ready < num_threads) {
+        std::this_thread::yield();
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(duration);
+    stop.store(true, std::memory_order_relaxed);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    return total / elapsed.count();
+}
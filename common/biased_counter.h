@@ -0,0 +1,266 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Biased reference counter (Choi, Shull, Torrellas, "Biased Reference Counting", PACT'18).
+//
+// The thread that creates the counter owns it and updates `local_` with plain loads and
+// stores. Other threads update the atomic `shared_`, which may go below zero when they
+// release references the owner created. The owner merges both parts into `shared_` when
+// its local count drops to zero; from then on every thread uses `shared_`.
+//
+// A release that drives `shared_` below zero while the owner still has the bias queues the
+// counter to its owner, which merges it on its next `DecRef` (or `MergeQueued`, or thread
+// exit). If the merged count is zero the owner calls the `SetOnZero` callback, so this
+// counter requires a user that can be released asynchronously, like `ControlBlock`.
+//
+// `DecRef` returns zero exactly once, when the caller must destroy the object. Other
+// returned values are not exact counts.
+class BiasedCounter {
+public:
+    using OnZero = void (*)(void*);
+
+    explicit BiasedCounter(size_t initial) : owner_(Owner::Acquire()), local_(initial) {
+    }
+    BiasedCounter(const BiasedCounter&) = delete;
+    BiasedCounter& operator=(const BiasedCounter&) = delete;
+    ~BiasedCounter() {
+        owner_->Release();
+    }
+
+    void SetOnZero(OnZero on_zero, void* context) {
+        on_zero_ = on_zero;
+        context_ = context;
+    }
+
+    void IncRef(size_t count = 1) {
+        if (IsOwner() && !merged_) {
+            local_.store(local_.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+            return;
+        }
+        shared_.fetch_add(count * kOne, std::memory_order_relaxed);
+    }
+
+    size_t DecRef(size_t count = 1) {
+        if (IsOwner()) {
+            owner_->MergeQueued();
+            if (!merged_) {
+                size_t local = local_.load(std::memory_order_relaxed);
+                if (count < local) {
+                    local_.store(local - count, std::memory_order_relaxed);
+                    return local - count;
+                }
+                // Local part is used up: give up the bias.
+                int64_t value = Merge(count);
+                if (value & kQueued) {
+                    Unqueue();
+                }
+                return Count(value);
+            }
+        }
+
+        int64_t delta = count * kOne;
+        int64_t value = shared_.load(std::memory_order_relaxed);
+        while (!(value & kMerged)) {
+            if (value < delta) {
+                return DecRefSlow(count);
+            }
+            if (shared_.compare_exchange_weak(value, value - delta, std::memory_order_acq_rel,
+                                              std::memory_order_relaxed)) {
+                // The owner still holds the bias, so this was not the last reference.
+                return 1;
+            }
+        }
+        return Count(shared_.fetch_sub(delta, std::memory_order_acq_rel) - delta);
+    }
+
+    // An unmerged counter is never destroyed, so only a merged zero is final.
+    bool IncRefIfNonZero() {
+        if (IsOwner() && !merged_) {
+            IncRef();
+            return true;
+        }
+        int64_t value = shared_.load(std::memory_order_relaxed);
+        do {
+            if ((value & kMerged) && Count(value) == 0) {
+                return false;
+            }
+        } while (!shared_.compare_exchange_weak(value, value + kOne, std::memory_order_acquire,
+                                                std::memory_order_relaxed));
+        return true;
+    }
+
+    size_t RefCount() const {
+        int64_t total = static_cast<int64_t>(local_.load(std::memory_order_relaxed)) +
+                        Count(shared_.load(std::memory_order_relaxed));
+        return total > 0 ? total : 0;
+    }
+
+    // Merges the counters other threads queued to the calling thread. Long-lived owner
+    // threads that stop releasing pointers may call it to flush deferred destructions.
+    static void MergeQueued() {
+        if (Owner* owner = Owner::Current()) {
+            owner->MergeQueued();
+        }
+    }
+
+private:
+    class Owner {
+    public:
+        static Owner* Current() {
+            return GetHolder().owner;
+        }
+
+        static Owner* Acquire() {
+            Holder& holder = GetHolder();
+            if (!holder.owner) {
+                holder.owner = new Owner;
+            }
+            holder.owner->refs_.fetch_add(1, std::memory_order_relaxed);
+            return holder.owner;
+        }
+
+        void Release() {
+            if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete this;
+            }
+        }
+
+        void MergeQueued() {
+            if (!pending_.load(std::memory_order_relaxed)) {
+                return;
+            }
+            // One at a time: a callback may release other queued counters of this thread.
+            while (BiasedCounter* counter = Pop()) {
+                counter->MergeFromQueue();
+            }
+        }
+
+    private:
+        friend class BiasedCounter;
+
+        struct Holder {
+            ~Holder() {
+                if (owner) {
+                    owner->Exit();
+                    owner->Release();
+                    owner = nullptr;
+                }
+            }
+
+            Owner* owner = nullptr;
+        };
+
+        static Holder& GetHolder() {
+            static thread_local Holder holder;
+            return holder;
+        }
+
+        BiasedCounter* Pop() {
+            std::lock_guard lock(mutex_);
+            if (queue_.empty()) {
+                pending_.store(false, std::memory_order_relaxed);
+                return nullptr;
+            }
+            BiasedCounter* counter = queue_.back();
+            queue_.pop_back();
+            return counter;
+        }
+
+        void Exit() {
+            {
+                std::lock_guard lock(mutex_);
+                exited_ = true;
+            }
+            pending_.store(true, std::memory_order_relaxed);
+            MergeQueued();
+        }
+
+        // Guards `queue_` and `exited_`, and orders the owner's last writes to `local_`
+        // before a merge done on its behalf after it exits.
+        std::mutex mutex_;
+        std::vector<BiasedCounter*> queue_;
+        bool exited_ = false;
+        std::atomic<bool> pending_ = false;
+        // One for the owning thread and one per live counter.
+        std::atomic<size_t> refs_ = 1;
+    };
+
+    static constexpr int64_t kMerged = 1;
+    static constexpr int64_t kQueued = 2;
+    static constexpr int64_t kOne = 4;
+
+    static int64_t Count(int64_t value) {
+        return value >> 2;
+    }
+
+    bool IsOwner() const {
+        return owner_ == Owner::Current();
+    }
+
+    // Folds `local_` into `shared_`, sets `kMerged` and drops `released` references, all in
+    // one RMW. Called by the owner, or by anyone once the owner has exited.
+    int64_t Merge(size_t released) {
+        int64_t local = local_.load(std::memory_order_relaxed);
+        int64_t delta = (local - static_cast<int64_t>(released)) * kOne + kMerged;
+        local_.store(0, std::memory_order_relaxed);
+        merged_ = true;
+        return shared_.fetch_add(delta, std::memory_order_acq_rel) + delta;
+    }
+
+    // The thread that set `kQueued` pushed us under the mutex; take us back out.
+    void Unqueue() {
+        std::lock_guard lock(owner_->mutex_);
+        auto& queue = owner_->queue_;
+        auto it = std::find(queue.begin(), queue.end(), this);
+        if (it != queue.end()) {
+            queue.erase(it);
+        }
+    }
+
+    // Owner thread, counter popped from the queue.
+    void MergeFromQueue() {
+        if (Count(Merge(0)) == 0 && on_zero_) {
+            on_zero_(context_);
+        }
+    }
+
+    // The release would take `shared_` below zero before the merge.
+    size_t DecRefSlow(size_t count) {
+        int64_t delta = count * kOne;
+        std::unique_lock lock(owner_->mutex_);
+        int64_t value = shared_.load(std::memory_order_relaxed);
+        if (owner_->exited_ && !(value & kMerged)) {
+            // Nobody touches `local_` any more, merge on the owner's behalf.
+            return Count(Merge(count));
+        }
+        do {
+            if (value & kMerged) {
+                lock.unlock();
+                return Count(shared_.fetch_sub(delta, std::memory_order_acq_rel) - delta);
+            }
+        } while (!shared_.compare_exchange_weak(value, (value - delta) | kQueued,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_relaxed));
+        if (!(value & kQueued)) {
+            owner_->queue_.push_back(this);
+            owner_->pending_.store(true, std::memory_order_relaxed);
+        }
+        return 1;
+    }
+
+    Owner* owner_;
+    // Written only by the owner; atomic so that `RefCount` may read it from any thread.
+    std::atomic<size_t> local_;
+    // Owner-only copy of `kMerged`.
+    bool merged_ = false;
+    // count << 2 | kQueued | kMerged
+    std::atomic<int64_t> shared_ = 0;
+    OnZero on_zero_ = nullptr;
+    void* context_ = nullptr;
+};
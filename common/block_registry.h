@@ -0,0 +1,269 @@
+#pragma once
+
+#include <cstddef>
+
+// Which control blocks a process holds, without a heap profiler. Enabled by
+// SMART_PTR_TRACK_BLOCKS, opt-in like refcount_profiler.h: every `ControlBlock` links itself into
+// a list of the creating thread while it exists, and `Snapshot::Take` sums up the live blocks
+// by pointee type: their number, the references to them, the age of the oldest one, and how
+// many of them are expired, i.e. kept only by `WeakPtr`s after their object was destroyed.
+//
+// Snapshots print as JSON with one line per type, sorted by type. `Snapshot::Diff` compares
+// two of them and keeps the types whose counts changed. A type whose block count keeps growing
+// between snapshots taken at the same point of a steady state is leaking; a growing `expired`
+// count points at `WeakPtr`s that are never dropped.
+//
+// Linking a block costs an uncontended mutex of the thread; a block freed by another thread
+// locks the list of the thread that created it.
+
+namespace block_registry {
+
+// Reference counts of a block as `SharedPtr` and `WeakPtr` see them.
+struct Counts {
+    size_t shared;
+    size_t weak;
+};
+
+}  // namespace block_registry
+
+#ifdef SMART_PTR_TRACK_BLOCKS
+
+#include "common/demangle.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+
+namespace block_registry {
+
+// Pointee type of a control block, in its manager table.
+struct TypeInfo {
+    const std::type_info* type;
+    size_t object_size;
+
+    template <typename T>
+    static constexpr TypeInfo Of() {
+        if constexpr (std::is_unbounded_array_v<T>) {
+            return {&typeid(T), sizeof(std::remove_extent_t<T>)};
+        } else {
+            return {&typeid(T), sizeof(T)};
+        }
+    }
+};
+
+class Entry;
+
+// The live blocks created by one thread. Never freed: blocks outlive their threads.
+struct ThreadList {
+    std::mutex mutex;
+    Entry* head = nullptr;
+};
+
+class Registry {
+public:
+    static Registry& Get() {
+        static Registry* registry = new Registry;
+        return *registry;
+    }
+
+    ThreadList* ListOfThisThread() {
+        constinit thread_local ThreadList* list = nullptr;
+        if (!list) {
+            list = new ThreadList;
+            std::lock_guard lock(mutex_);
+            lists_.push_back(list);
+        }
+        return list;
+    }
+
+    template <typename F>
+    void ForEachList(F f) {
+        std::lock_guard lock(mutex_);
+        for (ThreadList* list : lists_) {
+            f(*list);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<ThreadList*> lists_;
+};
+
+// Member of `ControlBlock`: links the block into the list of its thread while it exists.
+class Entry {
+public:
+    using CountsOf = Counts (*)(const void* block);
+
+    Entry(TypeInfo type, const void* block, CountsOf counts)
+        : type_(type),
+          block_(block),
+          counts_(counts),
+          created_(std::chrono::steady_clock::now()),
+          list_(Registry::Get().ListOfThisThread()) {
+        std::lock_guard lock(list_->mutex);
+        next_ = list_->head;
+        if (next_) {
+            next_->prev_ = this;
+        }
+        list_->head = this;
+    }
+    Entry(const Entry&) = delete;
+    Entry& operator=(const Entry&) = delete;
+    ~Entry() {
+        std::lock_guard lock(list_->mutex);
+        (prev_ ? prev_->next_ : list_->head) = next_;
+        if (next_) {
+            next_->prev_ = prev_;
+        }
+    }
+
+private:
+    friend class Snapshot;
+
+    TypeInfo type_;
+    const void* block_;
+    CountsOf counts_;
+    std::chrono::steady_clock::time_point created_;
+    ThreadList* list_;
+    Entry* prev_ = nullptr;
+    Entry* next_ = nullptr;
+};
+
+// Live blocks by pointee type. Fields are signed to hold the differences of `Diff` too.
+class Snapshot {
+public:
+    struct Type {
+        size_t object_size = 0;
+        int64_t blocks = 0;
+        // Blocks whose object is destroyed, kept by `WeakPtr`s only.
+        int64_t expired = 0;
+        int64_t shared_refs = 0;
+        int64_t weak_refs = 0;
+        double oldest_seconds = 0;
+    };
+
+    static Snapshot Take() {
+        Snapshot snapshot;
+        auto now = std::chrono::steady_clock::now();
+        Registry::Get().ForEachList([&](ThreadList& list) {
+            std::lock_guard lock(list.mutex);
+            for (const Entry* entry = list.head; entry; entry = entry->next_) {
+                Type& type = snapshot.types_[Demangle(entry->type_.type->name())];
+                Counts counts = entry->counts_(entry->block_);
+                type.object_size = entry->type_.object_size;
+                ++type.blocks;
+                type.expired += counts.shared == 0;
+                type.shared_refs += counts.shared;
+                type.weak_refs += counts.weak;
+                std::chrono::duration<double> age = now - entry->created_;
+                type.oldest_seconds = std::max(type.oldest_seconds, age.count());
+            }
+        });
+        return snapshot;
+    }
+
+    // `after` minus `before`, without the types that did not change. `oldest_seconds` is the
+    // one of `after`.
+    static Snapshot Diff(const Snapshot& before, const Snapshot& after) {
+        Snapshot diff;
+        auto add = [&](const std::string& name, const Type& type, int64_t sign) {
+            Type& delta = diff.types_[name];
+            delta.object_size = type.object_size;
+            delta.blocks += sign * type.blocks;
+            delta.expired += sign * type.expired;
+            delta.shared_refs += sign * type.shared_refs;
+            delta.weak_refs += sign * type.weak_refs;
+            if (sign > 0) {
+                delta.oldest_seconds = type.oldest_seconds;
+            }
+        };
+        for (const auto& [name, type] : before.types_) {
+            add(name, type, -1);
+        }
+        for (const auto& [name, type] : after.types_) {
+            add(name, type, 1);
+        }
+        std::erase_if(diff.types_, [](const auto& item) {
+            const Type& type = item.second;
+            return type.blocks == 0 && type.expired == 0 && type.shared_refs == 0 &&
+                   type.weak_refs == 0;
+        });
+        return diff;
+    }
+
+    const std::map<std::string, Type>& Types() const {
+        return types_;
+    }
+
+    void WriteJson(FILE* out) const {
+        std::fprintf(out, "{\"types\": [\n");
+        size_t i = 0;
+        for (const auto& [name, type] : types_) {
+            std::fprintf(out,
+                         "  {\"type\": \"%s\", \"object_size\": %zu, \"blocks\": %" PRId64
+                         ", \"expired\": %" PRId64 ", \"shared_refs\": %" PRId64
+                         ", \"weak_refs\": %" PRId64 ", \"oldest_seconds\": %.3f}%s\n",
+                         Escape(name).c_str(), type.object_size, type.blocks, type.expired,
+                         type.shared_refs, type.weak_refs, type.oldest_seconds,
+                         ++i < types_.size() ? "," : "");
+        }
+        std::fprintf(out, "]}\n");
+    }
+
+    // Returns false if the file cannot be written.
+    bool WriteJson(const char* path) const {
+        FILE* out = std::fopen(path, "w");
+        if (!out) {
+            return false;
+        }
+        WriteJson(out);
+        return std::fclose(out) == 0;
+    }
+
+private:
+    static std::string Escape(const std::string& name) {
+        std::string escaped;
+        for (char c : name) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    std::map<std::string, Type> types_;
+};
+
+}  // namespace block_registry
+
+#else
+
+namespace block_registry {
+
+struct TypeInfo {
+    template <typename T>
+    static constexpr TypeInfo Of() {
+        return {};
+    }
+};
+
+class Entry {
+public:
+    using CountsOf = Counts (*)(const void* block);
+
+    Entry(TypeInfo, const void*, CountsOf) {
+    }
+};
+
+}  // namespace block_registry
+
+#endif
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+
+// Reference counters shared by `RefCounted` and `ControlBlock`.
+//
+// `IncRef`/`DecRef` return the new value of the counter, so the caller can
+// test for zero without reading the counter again. Both take an optional count
+// for callers that move references in batches (see `AtomicSharedPtr`).
+// `IsUnique` lets the owner of the last reference skip its `DecRef`, see
+// `ControlBlock::DelShared`.
+
+class SimpleCounter {
+public:
+    SimpleCounter() = default;
+    explicit SimpleCounter(size_t initial) : count_(initial) {
+    }
+
+    size_t IncRef(size_t count = 1) {
+        return count_ += count;
+    }
+    size_t DecRef(size_t count = 1) {
+        return count_ -= count;
+    }
+    bool IncRefIfNonZero() {
+        if (count_ == 0) {
+            return false;
+        }
+        ++count_;
+        return true;
+    }
+    size_t RefCount() const {
+        return count_;
+    }
+    bool IsUnique() const {
+        return count_ == 1;
+    }
+
+private:
+    size_t count_ = 0;
+};
+
+// Safe to share between threads.
+// Increments are relaxed: a new reference can only be made from an existing one,
+// so the object is already visible to the incrementing thread.
+// Decrements are acq_rel: every write made through a reference happens-before
+// the destruction performed by the thread that drops the last one.
+class AtomicCounter {
+public:
+    AtomicCounter() = default;
+    explicit AtomicCounter(size_t initial) : count_(initial) {
+    }
+
+    size_t IncRef(size_t count = 1) {
+        return count_.fetch_add(count, std::memory_order_relaxed) + count;
+    }
+    size_t DecRef(size_t count = 1) {
+        return count_.fetch_sub(count, std::memory_order_acq_rel) - count;
+    }
+    // Used by `WeakPtr::Lock`: never resurrects a counter that already dropped to zero.
+    bool IncRefIfNonZero() {
+        size_t current = count_.load(std::memory_order_relaxed);
+        do {
+            if (current == 0) {
+                return false;
+            }
+        } while (!count_.compare_exchange_weak(current, current + 1, std::memory_order_acquire,
+                                               std::memory_order_relaxed));
+        return true;
+    }
+    size_t RefCount() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+    // Acquire, like a last `DecRef`: the caller may destroy the object.
+    bool IsUnique() const {
+        return count_.load(std::memory_order_acquire) == 1;
+    }
+
+private:
+    std::atomic<size_t> count_ = 0;
+};
+
+// Narrow counters for objects with many instances, `Int` is `uint8_t`, `uint16_t` or `uint32_t`.
+// A counter that reaches `kSaturated` stays there and the object is never destroyed: it leaks
+// instead of being freed while references remain.
+
+template <typename Int>
+class SaturatingCounter {
+    static_assert(std::is_unsigned_v<Int>);
+
+public:
+    static constexpr size_t kSaturated = std::numeric_limits<Int>::max();
+
+    SaturatingCounter() = default;
+    explicit SaturatingCounter(size_t initial) : count_(initial) {
+    }
+
+    size_t IncRef(size_t count = 1) {
+        count_ = count < kSaturated - count_ ? count_ + count : kSaturated;
+        return count_;
+    }
+    size_t DecRef(size_t count = 1) {
+        if (count_ != kSaturated) {
+            count_ -= count;
+        }
+        return count_;
+    }
+    bool IncRefIfNonZero() {
+        if (count_ == 0) {
+            return false;
+        }
+        IncRef();
+        return true;
+    }
+    size_t RefCount() const {
+        return count_;
+    }
+    bool IsUnique() const {
+        return count_ == 1;
+    }
+
+private:
+    Int count_ = 0;
+};
+
+// Same ordering as `AtomicCounter`, and still a single RMW per update: a counter found at or
+// above `kSaturated` is put back to it. The quarter of the range above `kSaturated` absorbs
+// increments racing with that store, so batches must be smaller than it: `AtomicSharedPtr`
+// needs at least 16 bits.
+template <typename Int>
+class AtomicSaturatingCounter {
+    static_assert(std::is_unsigned_v<Int>);
+
+public:
+    static constexpr size_t kSaturated = std::numeric_limits<Int>::max() / 4 * 3;
+
+    AtomicSaturatingCounter() = default;
+    explicit AtomicSaturatingCounter(size_t initial) : count_(initial) {
+    }
+
+    size_t IncRef(size_t count = 1) {
+        size_t result = count_.fetch_add(count, std::memory_order_relaxed) + count;
+        if (result >= kSaturated) {
+            count_.store(kSaturated, std::memory_order_relaxed);
+            return kSaturated;
+        }
+        return result;
+    }
+    size_t DecRef(size_t count = 1) {
+        size_t old = count_.fetch_sub(count, std::memory_order_acq_rel);
+        if (old >= kSaturated) {
+            count_.store(kSaturated, std::memory_order_relaxed);
+            return kSaturated;
+        }
+        return old - count;
+    }
+    bool IncRefIfNonZero() {
+        Int current = count_.load(std::memory_order_relaxed);
+        do {
+            if (current == 0) {
+                return false;
+            }
+            if (current >= kSaturated) {
+                return true;
+            }
+        } while (!count_.compare_exchange_weak(current, static_cast<Int>(current + 1),
+                                               std::memory_order_acquire,
+                                               std::memory_order_relaxed));
+        return true;
+    }
+    size_t RefCount() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+    bool IsUnique() const {
+        return count_.load(std::memory_order_acquire) == 1;
+    }
+
+private:
+    std::atomic<Int> count_ = 0;
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cxxabi.h>
+
+#include <cstdlib>
+#include <string>
+
+// Readable name of a type for the reports of the profilers, from `typeid(T).name()`. Returns
+// `name` unchanged if it cannot be demangled.
+inline std::string Demangle(const char* name) {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (status != 0) {
+        return name;
+    }
+    std::string result = demangled;
+    std::free(demangled);
+    return result;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+// Destruction on a budget, for event loops that cannot afford to destroy a large object graph
+// at once when its last pointer goes away.
+//
+// Objects whose count drops to zero are queued instead of destroyed: intrusive objects with the
+// `DeferredDelete` deleter (intrusive/intrusive.h), and objects of `SharedPtr` blocks whose
+// pointee type specializes `DeferDestruction`. The loop calls `Drain` once per frame: it destroys
+// the oldest objects, grouped by type so that the destructors of one type run back to back, until
+// the time or count budget is spent. Pointers owned by a destroyed object are released as usual,
+// so a tree is torn down level by level over several frames rather than in one cascade.
+//
+// Objects are destroyed by the thread that calls `Drain`, whichever thread dropped them. A weak
+// pointer to a queued object is already expired.
+class DestructionQueue {
+public:
+    using Destroy = void (*)(void*);
+
+    // At least one object is destroyed per `Drain` if any is queued, so that every frame makes
+    // progress even if the budget is spent elsewhere.
+    struct Budget {
+        std::chrono::nanoseconds time = std::chrono::nanoseconds::max();
+        size_t count = std::numeric_limits<size_t>::max();
+    };
+
+    struct Metrics {
+        size_t depth = 0;
+        // Time since the oldest queued object was dropped, zero if the queue is empty.
+        std::chrono::nanoseconds backlog_age{0};
+        uint64_t enqueued = 0;
+        uint64_t destroyed = 0;
+    };
+
+    DestructionQueue() = default;
+    DestructionQueue(const DestructionQueue&) = delete;
+    DestructionQueue& operator=(const DestructionQueue&) = delete;
+
+    // Never destroyed: static pointers may drop their objects after it would be. What is still
+    // queued at exit is destroyed with no budget, and objects dropped later are destroyed at once.
+    static DestructionQueue& Get() {
+        static DestructionQueue* queue = [] {
+            auto* queue = new DestructionQueue;
+            std::atexit([] { Get().DrainAtExit(); });
+            return queue;
+        }();
+        return *queue;
+    }
+
+    // Queues `destroy(object)`. `type` is the same for all objects of one type and orders them
+    // in `Drain`.
+    void Enqueue(Destroy destroy, void* object, const void* type) {
+        {
+            std::lock_guard lock(mutex_);
+            if (!exited_) {
+                queue_.push_back({destroy, object, type, std::chrono::steady_clock::now()});
+                ++enqueued_;
+                return;
+            }
+        }
+        destroy(object);
+    }
+
+    // Destroys everything, also what the destructors queue.
+    size_t Drain() {
+        return Drain(Budget{});
+    }
+    // Returns the number of objects destroyed. Objects queued by the destructors run here are
+    // destroyed in the same call if the budget allows.
+    size_t Drain(Budget budget) {
+        auto start = std::chrono::steady_clock::now();
+        size_t destroyed = 0;
+        std::vector<Item> batch;
+        while (destroyed < budget.count) {
+            {
+                std::lock_guard lock(mutex_);
+                size_t size = std::min(queue_.size(), budget.count - destroyed);
+                if (size == 0) {
+                    break;
+                }
+                batch.assign(queue_.begin(), queue_.begin() + size);
+                queue_.erase(queue_.begin(), queue_.begin() + size);
+            }
+            std::stable_sort(batch.begin(), batch.end(), [](const Item& lhs, const Item& rhs) {
+                return std::less<const void*>{}(lhs.type, rhs.type);
+            });
+            size_t done = 0;
+            for (; done < batch.size(); ++done) {
+                if (destroyed > 0 && std::chrono::steady_clock::now() - start >= budget.time) {
+                    break;
+                }
+                batch[done].destroy(batch[done].object);
+                ++destroyed;
+            }
+            if (done < batch.size()) {
+                Requeue(batch, done);
+                break;
+            }
+        }
+        std::lock_guard lock(mutex_);
+        destroyed_ += destroyed;
+        return destroyed;
+    }
+
+    Metrics GetMetrics() const {
+        std::lock_guard lock(mutex_);
+        Metrics metrics;
+        metrics.depth = queue_.size();
+        if (!queue_.empty()) {
+            metrics.backlog_age = std::chrono::steady_clock::now() - queue_.front().enqueued;
+        }
+        metrics.enqueued = enqueued_;
+        metrics.destroyed = destroyed_;
+        return metrics;
+    }
+
+private:
+    struct Item {
+        Destroy destroy;
+        void* object;
+        const void* type;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    void DrainAtExit() {
+        {
+            std::lock_guard lock(mutex_);
+            exited_ = true;
+        }
+        Drain();
+    }
+
+    // Puts the rest of a batch back in front, oldest first: it was dropped before anything
+    // still queued.
+    void Requeue(std::vector<Item>& batch, size_t done) {
+        std::stable_sort(batch.begin() + done, batch.end(), [](const Item& lhs, const Item& rhs) {
+            return lhs.enqueued < rhs.enqueued;
+        });
+        std::lock_guard lock(mutex_);
+        queue_.insert(queue_.begin(), batch.begin() + done, batch.end());
+    }
+
+    mutable std::mutex mutex_;
+    std::deque<Item> queue_;
+    uint64_t enqueued_ = 0;
+    uint64_t destroyed_ = 0;
+    bool exited_ = false;
+};
+
+// Specialize as `std::true_type` for objects that `SharedPtr` should destroy through
+// `DestructionQueue` rather than when their last owner goes away.
+template <typename T>
+struct DeferDestruction : std::false_type {};
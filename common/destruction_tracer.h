@@ -0,0 +1,198 @@
+#pragma once
+
+#include <cstddef>
+
+// How long it takes to destroy objects when their last reference goes away, per type. Enabled
+// by SMART_PTR_TRACE_DESTRUCTION, opt-in like refcount_profiler.h: `ControlBlock::OnZeroShared`
+// and the `Deleter::Destroy` call of `RefCounted::DecRef` record, for the type of the object,
+// the time the destruction took and the number of destructions it cascaded into (itself
+// included) in two `Histogram`s. A type whose tail latency or cascade size is large is a
+// candidate for deferred destruction (common/destruction_queue.h).
+//
+// `StatsOf<T>()` and `ForEachType` query the histograms while the program runs, `PrintReport`
+// summarizes them.
+
+#ifdef SMART_PTR_TRACE_DESTRUCTION
+
+#include "common/demangle.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace destruction_tracer {
+
+// Log-linear buckets as in HdrHistogram: values below 16 are exact, larger ones fall into one
+// of 16 buckets per power of two, so a percentile is within 1/16 of the recorded value.
+class Histogram {
+public:
+    void Record(uint64_t value) {
+        counts_[Bucket(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while (max < value &&
+               !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t Count() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+    uint64_t Max() const {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    // Upper bound of the bucket holding the `percentile`-th value, `percentile` in [0, 100].
+    uint64_t Percentile(double percentile) const {
+        uint64_t count = Count();
+        if (count == 0) {
+            return 0;
+        }
+        auto rank = static_cast<uint64_t>(percentile / 100 * static_cast<double>(count));
+        rank = std::max<uint64_t>(1, std::min(rank, count));
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < kNumBuckets; ++bucket) {
+            seen += counts_[bucket].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return std::min(UpperBound(bucket), Max());
+            }
+        }
+        return Max();
+    }
+
+private:
+    static constexpr int kSubBits = 4;
+    static constexpr uint64_t kSubBuckets = 1 << kSubBits;
+    static constexpr size_t kNumBuckets = kSubBuckets * (64 - kSubBits + 1);
+
+    static size_t Bucket(uint64_t value) {
+        if (value < kSubBuckets) {
+            return value;
+        }
+        int shift = std::bit_width(value) - kSubBits - 1;
+        return kSubBuckets * (shift + 1) + ((value >> shift) - kSubBuckets);
+    }
+    static uint64_t UpperBound(size_t bucket) {
+        if (bucket < kSubBuckets) {
+            return bucket;
+        }
+        int shift = static_cast<int>(bucket / kSubBuckets) - 1;
+        uint64_t mantissa = bucket % kSubBuckets + kSubBuckets;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    std::atomic<uint64_t> counts_[kNumBuckets] = {};
+    std::atomic<uint64_t> count_ = 0;
+    std::atomic<uint64_t> max_ = 0;
+};
+
+struct TypeStats {
+    std::string name;
+    Histogram nanoseconds;
+    // Destructions per destruction, itself included: 1 for an object that owns nothing.
+    Histogram cascade;
+};
+
+class Registry {
+public:
+    static Registry& Get() {
+        static Registry* registry = new Registry;
+        return *registry;
+    }
+
+    TypeStats* Add(const char* mangled_name) {
+        auto* stats = new TypeStats;
+        stats->name = Demangle(mangled_name);
+        std::lock_guard lock(mutex_);
+        types_.push_back(stats);
+        return stats;
+    }
+
+    template <typename F>
+    void ForEach(F f) {
+        std::lock_guard lock(mutex_);
+        for (const TypeStats* stats : types_) {
+            f(*stats);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<TypeStats*> types_;
+};
+
+template <typename T>
+TypeStats& StatsOf() {
+    static TypeStats* stats = Registry::Get().Add(typeid(T).name());
+    return *stats;
+}
+
+// Calls `f(const TypeStats&)` for every type destroyed so far.
+template <typename F>
+void ForEachType(F f) {
+    Registry::Get().ForEach(f);
+}
+
+inline void PrintReport(FILE* out = stderr) {
+    std::fprintf(out, "%10s %10s %10s %10s %12s %10s %10s  %s\n", "count", "p50 (ns)", "p99 (ns)",
+                 "p99.9 (ns)", "max (ns)", "p99 casc", "max casc", "type");
+    ForEachType([out](const TypeStats& stats) {
+        const Histogram& ns = stats.nanoseconds;
+        std::fprintf(out, "%10llu %10llu %10llu %10llu %12llu %10llu %10llu  %s\n",
+                     static_cast<unsigned long long>(ns.Count()),
+                     static_cast<unsigned long long>(ns.Percentile(50)),
+                     static_cast<unsigned long long>(ns.Percentile(99)),
+                     static_cast<unsigned long long>(ns.Percentile(99.9)),
+                     static_cast<unsigned long long>(ns.Max()),
+                     static_cast<unsigned long long>(stats.cascade.Percentile(99)),
+                     static_cast<unsigned long long>(stats.cascade.Max()), stats.name.c_str());
+    });
+}
+
+// Destructions started by this thread so far.
+inline constinit thread_local uint64_t destructions = 0;
+
+// Spans the destruction of one `T`.
+template <typename T>
+class Trace {
+public:
+    Trace() : first_(++destructions), begin_(std::chrono::steady_clock::now()) {
+    }
+    Trace(const Trace&) = delete;
+    Trace& operator=(const Trace&) = delete;
+    ~Trace() {
+        std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - begin_;
+        TypeStats& stats = StatsOf<T>();
+        stats.nanoseconds.Record(elapsed.count());
+        stats.cascade.Record(destructions - first_ + 1);
+    }
+
+private:
+    uint64_t first_;
+    std::chrono::steady_clock::time_point begin_;
+};
+
+}  // namespace destruction_tracer
+
+#else
+
+namespace destruction_tracer {
+
+template <typename T>
+class Trace {
+public:
+    Trace() = default;
+    Trace(const Trace&) = delete;
+    Trace& operator=(const Trace&) = delete;
+};
+
+}  // namespace destruction_tracer
+
+#endif
@@ -0,0 +1,218 @@
+#pragma once
+
+#include "common/counters.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Epoch-based reclamation (Fraser, "Practical lock-freedom").
+//
+// Threads read shared memory inside an `EpochGuard`. The global epoch advances only when every
+// thread inside a guard has seen the current one, so a callback retired in epoch `e` runs once
+// the epoch reaches `e + 2`: by then every guard that could see the retired memory is gone.
+//
+// Callbacks wait in a limbo list of the retiring thread and run in batches from `Retire` or
+// `Collect`. Lists left by exited threads are taken over by the next `Collect` of any thread.
+class EpochDomain {
+public:
+    using Reclaim = void (*)(void*);
+
+    EpochDomain() = default;
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+    // Runs at exit, when no thread is inside a guard any more.
+    ~EpochDomain() {
+        shutdown_ = true;
+        while (!orphans_.empty()) {
+            std::vector<Retired> orphans;
+            orphans.swap(orphans_);
+            for (const Retired& item : orphans) {
+                item.reclaim(item.context);
+            }
+        }
+        Record* record = records_.load(std::memory_order_acquire);
+        while (record) {
+            delete std::exchange(record, record->next);
+        }
+    }
+
+    static EpochDomain& Get() {
+        static EpochDomain domain;
+        return domain;
+    }
+
+    // Runs `reclaim(context)` once no thread can be inside a guard that began before the call.
+    void Retire(Reclaim reclaim, void* context) {
+        if (thread_exited) {
+            RetireAfterExit(reclaim, context);
+            return;
+        }
+        ThreadState& state = State();
+        state.limbo.push_back({reclaim, context, epoch_.load(std::memory_order_seq_cst)});
+        if (state.limbo.size() >= kCollectThreshold) {
+            Collect();
+        }
+    }
+
+    // Advances the epoch as far as the threads inside guards allow and runs every callback of
+    // this thread (and of exited threads) that is safe to run.
+    void Collect() {
+        ThreadState& state = State();
+        TryAdvance();
+        TryAdvance();
+        {
+            std::lock_guard lock(mutex_);
+            state.limbo.insert(state.limbo.end(), orphans_.begin(), orphans_.end());
+            orphans_.clear();
+        }
+
+        // Callbacks may retire more; those go to `state.limbo` and wait for the next round.
+        std::vector<Retired> limbo;
+        limbo.swap(state.limbo);
+        uint64_t epoch = epoch_.load(std::memory_order_acquire);
+        std::vector<Retired> kept;
+        for (const Retired& item : limbo) {
+            if (item.epoch + 2 <= epoch) {
+                item.reclaim(item.context);
+            } else {
+                kept.push_back(item);
+            }
+        }
+        state.limbo.insert(state.limbo.end(), kept.begin(), kept.end());
+    }
+
+private:
+    friend class EpochGuard;
+
+    static constexpr uint64_t kActive = 1;
+    static constexpr size_t kCollectThreshold = 64;
+
+    // Local epoch of one thread: `epoch << 1 | kActive` inside a guard, zero outside.
+    struct alignas(64) Record {
+        std::atomic<uint64_t> local = 0;
+        std::atomic<bool> in_use = true;
+        Record* next = nullptr;
+    };
+
+    struct Retired {
+        Reclaim reclaim;
+        void* context;
+        uint64_t epoch;
+    };
+
+    struct ThreadState {
+        // `Get()` first, so that the domain outlives the state of every thread.
+        ThreadState() : domain(Get()), record(domain.AcquireRecord()) {
+        }
+        ~ThreadState() {
+            thread_exited = true;
+            std::lock_guard lock(domain.mutex_);
+            domain.orphans_.insert(domain.orphans_.end(), limbo.begin(), limbo.end());
+            record->in_use.store(false, std::memory_order_release);
+        }
+
+        EpochDomain& domain;
+        Record* record;
+        size_t nesting = 0;
+        std::vector<Retired> limbo;
+    };
+
+    // Set once the state of the thread is destroyed, e.g. for objects released by other
+    // thread-local destructors.
+    inline static thread_local bool thread_exited = false;
+
+    static ThreadState& State() {
+        static thread_local ThreadState state;
+        return state;
+    }
+
+    void Enter() {
+        ThreadState& state = State();
+        if (state.nesting++ == 0) {
+            // RMW, so that `TryAdvance` reading it also synchronizes with the previous `Exit`.
+            uint64_t epoch = epoch_.load(std::memory_order_relaxed);
+            state.record->local.exchange(epoch << 1 | kActive, std::memory_order_seq_cst);
+        }
+    }
+
+    void Exit() {
+        ThreadState& state = State();
+        if (--state.nesting == 0) {
+            state.record->local.store(0, std::memory_order_release);
+        }
+    }
+
+    bool TryAdvance() {
+        uint64_t epoch = epoch_.load(std::memory_order_seq_cst);
+        for (Record* record = records_.load(std::memory_order_acquire); record;
+             record = record->next) {
+            uint64_t local = record->local.load(std::memory_order_seq_cst);
+            if ((local & kActive) && (local >> 1) != epoch) {
+                return false;
+            }
+        }
+        return epoch_.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+    }
+
+    void RetireAfterExit(Reclaim reclaim, void* context) {
+        if (shutdown_) {
+            reclaim(context);
+            return;
+        }
+        std::lock_guard lock(mutex_);
+        orphans_.push_back({reclaim, context, epoch_.load(std::memory_order_seq_cst)});
+    }
+
+    Record* AcquireRecord() {
+        for (Record* record = records_.load(std::memory_order_acquire); record;
+             record = record->next) {
+            bool in_use = false;
+            if (!record->in_use.load(std::memory_order_relaxed) &&
+                record->in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire)) {
+                return record;
+            }
+        }
+        auto record = new Record;
+        record->next = records_.load(std::memory_order_relaxed);
+        while (!records_.compare_exchange_weak(record->next, record, std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+        }
+        return record;
+    }
+
+    std::atomic<uint64_t> epoch_ = 0;
+    std::atomic<Record*> records_ = nullptr;
+    // Guards `orphans_`.
+    std::mutex mutex_;
+    std::vector<Retired> orphans_;
+    bool shutdown_ = false;
+};
+
+// Memory retired through `EpochDomain` stays valid while the guard is alive. Guards nest.
+class EpochGuard {
+public:
+    EpochGuard() {
+        EpochDomain::Get().Enter();
+    }
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+    ~EpochGuard() {
+        EpochDomain::Get().Exit();
+    }
+};
+
+// `AtomicCounter` for control blocks that destroy the object through `EpochDomain`: a raw
+// pointer to the object (or to its control block) loaded inside an `EpochGuard` stays valid
+// until the guard ends, even if the last `SharedPtr` is released meanwhile.
+class EpochCounter : public AtomicCounter {
+public:
+    using AtomicCounter::AtomicCounter;
+
+    void Retire(EpochDomain::Reclaim reclaim, void* context) {
+        EpochDomain::Get().Retire(reclaim, context);
+    }
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+// Shared and weak counts of a `ControlBlock` in one atomic 64-bit word, 32 bits each, for
+// programs with many small blocks: the block keeps 8 bytes of counters instead of 16, and
+// `WeakPtr::Lock`, expiry checks and releases are each a single atomic operation on that word.
+// The last shared owner of a block without weak pointers destroys the object and frees the
+// block after one `fetch_sub`.
+//
+// For `ControlBlock` only, which detects it by `IncWeak`. Either count overflowing its 32 bits
+// fails an assertion in debug builds.
+class PackedCounter {
+public:
+    struct Counts {
+        size_t shared;
+        size_t weak;
+    };
+
+    PackedCounter(size_t shared, size_t weak) : word_(Pack(shared, weak)) {
+    }
+    PackedCounter(const PackedCounter&) = delete;
+    PackedCounter& operator=(const PackedCounter&) = delete;
+
+    // Same ordering as `AtomicCounter`: relaxed increments, acq_rel decrements.
+    void IncShared(size_t count = 1) {
+        [[maybe_unused]] uint64_t old =
+            word_.fetch_add(Pack(count, 0), std::memory_order_relaxed);
+        assert(GetShared(old) + count <= kMaxCount && "Shared count overflow");
+    }
+    bool IncSharedIfNonZero() {
+        uint64_t current = word_.load(std::memory_order_relaxed);
+        do {
+            if (GetShared(current) == 0) {
+                return false;
+            }
+            assert(GetShared(current) < kMaxCount && "Shared count overflow");
+        } while (!word_.compare_exchange_weak(current, current + kOneShared,
+                                              std::memory_order_acquire,
+                                              std::memory_order_relaxed));
+        return true;
+    }
+    // Both counts right after the decrement.
+    Counts DecShared(size_t count = 1) {
+        uint64_t word = word_.fetch_sub(Pack(count, 0), std::memory_order_acq_rel) - Pack(count, 0);
+        return {GetShared(word), GetWeak(word)};
+    }
+
+    void IncWeak(size_t count = 1) {
+        [[maybe_unused]] uint64_t old = word_.fetch_add(Pack(0, count), std::memory_order_relaxed);
+        assert(GetWeak(old) + count <= kMaxCount && "Weak count overflow");
+    }
+    // The weak count right after the decrement.
+    size_t DecWeak(size_t count = 1) {
+        return GetWeak(word_.fetch_sub(Pack(0, count), std::memory_order_acq_rel) -
+                       Pack(0, count));
+    }
+
+    size_t SharedCount() const {
+        return GetShared(word_.load(std::memory_order_relaxed));
+    }
+    size_t WeakCount() const {
+        return GetWeak(word_.load(std::memory_order_relaxed));
+    }
+
+private:
+    static constexpr int kWeakShift = 32;
+    static constexpr uint64_t kMaxCount = (uint64_t{1} << kWeakShift) - 1;
+    static constexpr uint64_t kOneShared = 1;
+
+    static uint64_t Pack(uint64_t shared, uint64_t weak) {
+        return shared | weak << kWeakShift;
+    }
+    static size_t GetShared(uint64_t word) {
+        return word & kMaxCount;
+    }
+    static size_t GetWeak(uint64_t word) {
+        return word >> kWeakShift;
+    }
+
+    std::atomic<uint64_t> word_;
+};
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cstddef>
+
+// Counts reference count updates per pointee type and per thread, to find the `SharedPtr`s
+// passed by value that could be moved or borrowed instead. Opt-in: define
+// SMART_PTR_PROFILE_REFCOUNTS for the whole program. Then `ControlBlock` counts its
+// `AddShared` (successful `TryAddShared` included), `DelShared`, `AddWeak` and `DelWeak`
+// calls, `RefCounted` its `IncRef` and `DecRef` calls, and a report ranking the types by
+// traffic goes to stderr at exit (or wherever `PrintReport` is called).
+//
+// Without the macro `TypeKey` and `Counters` are empty and every call compiles to nothing.
+//
+// Each thread counts into a table of its own with plain relaxed stores, so counting never
+// makes threads share a cache line. Types past the first `kMaxTypes` are counted together.
+
+namespace refcount_profiler {
+
+enum class Op { kAddShared, kDelShared, kAddWeak, kDelWeak, kIncRef, kDecRef, kCount };
+
+}  // namespace refcount_profiler
+
+#ifdef SMART_PTR_PROFILE_REFCOUNTS
+
+#include "common/demangle.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+namespace refcount_profiler {
+
+inline constexpr size_t kMaxTypes = 512;
+inline constexpr size_t kNumOps = static_cast<size_t>(Op::kCount);
+
+struct ThreadTable {
+    size_t thread_index;
+    std::atomic<uint64_t> counts[kMaxTypes][kNumOps];
+};
+
+// Thread tables are never freed, so that the report at exit includes exited threads.
+class Registry {
+public:
+    static Registry& Get() {
+        static Registry* registry = new Registry;
+        return *registry;
+    }
+
+    size_t AddType(const char* mangled_name) {
+        std::lock_guard lock(mutex_);
+        if (type_names_.size() + 1 < kMaxTypes) {
+            type_names_.push_back(mangled_name);
+            return type_names_.size() - 1;
+        }
+        return kMaxTypes - 1;
+    }
+
+    ThreadTable* AddThread() {
+        auto* table = new ThreadTable{};
+        std::lock_guard lock(mutex_);
+        table->thread_index = tables_.size();
+        tables_.push_back(table);
+        return table;
+    }
+
+    // Over all threads.
+    uint64_t Total(size_t type, Op op) {
+        std::lock_guard lock(mutex_);
+        uint64_t total = 0;
+        for (ThreadTable* table : tables_) {
+            total += table->counts[type][static_cast<size_t>(op)].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    void PrintReport(FILE* out) {
+        std::lock_guard lock(mutex_);
+        std::vector<Row> rows = EmptyRows();
+        for (ThreadTable* table : tables_) {
+            Accumulate(*table, rows);
+        }
+        std::fprintf(out, "refcount traffic by type\n");
+        std::fprintf(out, "%12s %12s %12s %12s %12s %12s %14s  %s\n", "add_shared",
+                     "del_shared", "add_weak", "del_weak", "inc_ref", "dec_ref", "total", "type");
+        PrintRanked(out, std::move(rows), kMaxTypes);
+
+        for (ThreadTable* table : tables_) {
+            std::vector<Row> thread_rows = EmptyRows();
+            if (uint64_t total = Accumulate(*table, thread_rows)) {
+                std::fprintf(out, "thread %zu: %llu updates, top types\n", table->thread_index,
+                             static_cast<unsigned long long>(total));
+                PrintRanked(out, std::move(thread_rows), 5);
+            }
+        }
+    }
+
+private:
+    struct Row {
+        std::string name;
+        uint64_t counts[kNumOps] = {};
+        uint64_t total = 0;
+    };
+
+    // One row per type, the last one for the types past `kMaxTypes`.
+    std::vector<Row> EmptyRows() const {
+        std::vector<Row> rows(type_names_.size() + 1);
+        for (size_t type = 0; type < type_names_.size(); ++type) {
+            rows[type].name = Demangle(type_names_[type]);
+        }
+        rows.back().name = "(other types)";
+        return rows;
+    }
+
+    // Adds the counts of `table` to `rows`, returns their sum.
+    uint64_t Accumulate(const ThreadTable& table, std::vector<Row>& rows) const {
+        uint64_t total = 0;
+        for (size_t type = 0; type < kMaxTypes; ++type) {
+            Row& row = type < type_names_.size() ? rows[type] : rows.back();
+            for (size_t op = 0; op < kNumOps; ++op) {
+                uint64_t count = table.counts[type][op].load(std::memory_order_relaxed);
+                row.counts[op] += count;
+                row.total += count;
+                total += count;
+            }
+        }
+        return total;
+    }
+
+    static void PrintRanked(FILE* out, std::vector<Row> rows, size_t limit) {
+        std::sort(rows.begin(), rows.end(),
+                  [](const Row& lhs, const Row& rhs) { return lhs.total > rhs.total; });
+        for (size_t i = 0; i < std::min(limit, rows.size()) && rows[i].total > 0; ++i) {
+            for (uint64_t count : rows[i].counts) {
+                std::fprintf(out, "%12llu ", static_cast<unsigned long long>(count));
+            }
+            std::fprintf(out, "%14llu  %s\n", static_cast<unsigned long long>(rows[i].total),
+                         rows[i].name.c_str());
+        }
+    }
+
+    std::mutex mutex_;
+    std::vector<const char*> type_names_;
+    std::vector<ThreadTable*> tables_;
+};
+
+inline void PrintReport(FILE* out = stderr) {
+    Registry::Get().PrintReport(out);
+}
+
+struct ReportAtExit {
+    ~ReportAtExit() {
+        PrintReport(stderr);
+    }
+};
+inline ReportAtExit report_at_exit;
+
+template <typename T>
+size_t TypeId() {
+    static const size_t id = Registry::Get().AddType(typeid(T).name());
+    return id;
+}
+
+inline void Count(size_t type, Op op) {
+    constinit thread_local ThreadTable* table = nullptr;
+    if (!table) {
+        table = Registry::Get().AddThread();
+    }
+    auto& counter = table->counts[type][static_cast<size_t>(op)];
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+template <typename T>
+void Count(Op op) {
+    Count(TypeId<T>(), op);
+}
+
+// Calls of `op` on references to `T` so far, by all threads.
+template <typename T>
+uint64_t Total(Op op) {
+    return Registry::Get().Total(TypeId<T>(), op);
+}
+
+// Identifies the pointee type of a control block, in its manager table.
+class TypeKey {
+public:
+    template <typename T>
+    static constexpr TypeKey Of() {
+        return TypeKey(&TypeId<T>);
+    }
+
+    size_t Id() const {
+        return id_();
+    }
+
+private:
+    constexpr explicit TypeKey(size_t (*id)()) : id_(id) {
+    }
+
+    size_t (*id_)();
+};
+
+// Per control block, counts updates as traffic of the pointee type.
+class Counters {
+public:
+    explicit Counters(TypeKey key) : type_(key.Id()) {
+    }
+
+    void Count(Op op) const {
+        refcount_profiler::Count(type_, op);
+    }
+
+private:
+    size_t type_;
+};
+
+}  // namespace refcount_profiler
+
+#else
+
+namespace refcount_profiler {
+
+template <typename T>
+void Count(Op) {
+}
+
+class TypeKey {
+public:
+    template <typename T>
+    static constexpr TypeKey Of() {
+        return {};
+    }
+};
+
+class Counters {
+public:
+    explicit Counters(TypeKey) {
+    }
+
+    void Count(Op) const {
+    }
+};
+
+}  // namespace refcount_profiler
+
+#endif
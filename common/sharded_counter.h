@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+// Reference counter for a few hot objects copied by many threads at once (after the Linux
+// kernel's `percpu_ref`). Every thread updates its own cache-line sized shard, so copies made
+// and dropped by the same thread never share a cache line with other threads.
+//
+// The first reference lives in `central_` and shards never go below zero, so the total can
+// only reach zero through a thread that finds its own shard empty. That thread closes the
+// counter: it moves all shard counts into `central_`, and from then on every thread uses
+// `central_` like `AtomicCounter`. A reference created by one thread and dropped by another
+// may close the counter early; it stays correct but loses the sharding.
+//
+// For `RefCounted` only: there is no `IncRefIfNonZero`. Values returned before the counter is
+// closed are not exact counts, but never zero.
+template <size_t NumShards = 64>
+class ShardedCounter {
+public:
+    ShardedCounter() = default;
+    explicit ShardedCounter(size_t initial) : central_(initial), seeded_(initial > 0) {
+    }
+    ShardedCounter(const ShardedCounter&) = delete;
+    ShardedCounter& operator=(const ShardedCounter&) = delete;
+
+    size_t IncRef() {
+        // Read-mostly: written once, by the first reference.
+        if (!seeded_.load(std::memory_order_relaxed) &&
+            !seeded_.exchange(true, std::memory_order_relaxed)) {
+            central_.fetch_add(1, std::memory_order_relaxed);
+            return 1;
+        }
+        int64_t old = LocalShard().fetch_add(kOne, std::memory_order_relaxed);
+        if (old & kClosed) {
+            return central_.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+        return 1;
+    }
+
+    size_t DecRef() {
+        std::atomic<int64_t>& shard = LocalShard();
+        int64_t value = shard.load(std::memory_order_relaxed);
+        while (!(value & kClosed)) {
+            if (value < kOne) {
+                // Our reference is still counted, so nobody can destroy the object meanwhile.
+                Close();
+                break;
+            }
+            if (shard.compare_exchange_weak(value, value - kOne, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+                return 1;
+            }
+        }
+        return central_.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    }
+
+    size_t RefCount() const {
+        int64_t total = central_.load(std::memory_order_relaxed);
+        if (!closing_.load(std::memory_order_relaxed)) {
+            for (const Shard& shard : shards_) {
+                total += shard.value.load(std::memory_order_relaxed) >> 1;
+            }
+        }
+        return total > 0 ? total : 0;
+    }
+
+private:
+    static constexpr int64_t kClosed = 1;
+    static constexpr int64_t kOne = 2;
+    // Keeps `central_` above zero while the shards are being collected: threads with a closed
+    // shard already release their references there.
+    static constexpr int64_t kClosingBias = int64_t{1} << 62;
+
+    struct alignas(64) Shard {
+        // count << 1 | kClosed
+        std::atomic<int64_t> value = 0;
+    };
+
+    inline static std::atomic<size_t> next_thread_index = 0;
+
+    std::atomic<int64_t>& LocalShard() {
+        static thread_local size_t index = next_thread_index.fetch_add(1);
+        return shards_[index % NumShards].value;
+    }
+
+    // Returns once every shard is closed and its count is in `central_`.
+    void Close() {
+        if (closing_.exchange(true, std::memory_order_relaxed)) {
+            while (!closed_.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            return;
+        }
+        central_.fetch_add(kClosingBias, std::memory_order_relaxed);
+        int64_t total = 0;
+        for (Shard& shard : shards_) {
+            total += shard.value.fetch_or(kClosed, std::memory_order_acq_rel) >> 1;
+        }
+        central_.fetch_add(total - kClosingBias, std::memory_order_acq_rel);
+        closed_.store(true, std::memory_order_release);
+    }
+
+    Shard shards_[NumShards];
+    std::atomic<int64_t> central_ = 0;
+    std::atomic<bool> seeded_ = false;
+    std::atomic<bool> closing_ = false;
+    std::atomic<bool> closed_ = false;
+};
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cstddef>
+
+// Finds the call sites whose objects pile up in a long-running process. Opt-in: define
+// SMART_PTR_SAMPLE_SITES for the whole program. Then one in `SampleRate()` creations of
+// `PointingControlBlock`, `EmplacingControlBlock` and `ArrayControlBlock` (so `SharedPtr` from
+// `new`, `MakeShared` and `MakeShared<T[]>`) and of objects from `MakeIntrusive` records the
+// stack that created it. A sample lives as long as its object: `PrintReport` groups the live
+// samples by stack and ranks the stacks by the bytes they hold, scaled up by the sample rate.
+// `StartReportOnSignal` prints the report whenever the process gets a signal.
+//
+// Sampling is a thread-local countdown, so the objects that are not sampled only pay for a
+// decrement; the intervals between samples are random, so that periodic allocation patterns
+// do not skew the result. A sampled object holds a pointer to its sample, `Sample` below:
+// without the macro it is empty and every call compiles to nothing.
+//
+// Stacks come from `backtrace`; link with -rdynamic for readable symbols. Linux only.
+
+#ifdef SMART_PTR_SAMPLE_SITES
+
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace site_profiler {
+
+inline constexpr size_t kDefaultSampleRate = 1024;
+inline constexpr int kMaxFrames = 32;
+
+// One in `rate` creations is sampled on average, `rate == 1` samples every creation. Applies
+// to each thread from its next sample on.
+inline std::atomic<size_t> sample_rate = [] {
+    const char* rate = std::getenv("SMART_PTR_SAMPLE_RATE");
+    return rate ? std::max<size_t>(1, std::strtoull(rate, nullptr, 10)) : kDefaultSampleRate;
+}();
+
+inline void SetSampleRate(size_t rate) {
+    sample_rate.store(std::max<size_t>(rate, 1), std::memory_order_relaxed);
+}
+// At least 1, also for objects created before `sample_rate` is initialized.
+inline size_t SampleRate() {
+    return std::max<size_t>(1, sample_rate.load(std::memory_order_relaxed));
+}
+
+struct Record {
+    void* frames[kMaxFrames];
+    int depth;
+    size_t bytes;
+    // Rate in effect when the sample was taken, the weight of the sample in the report.
+    size_t rate;
+    Record* prev;
+    Record* next;
+};
+
+// Live samples of all threads. Taking and dropping samples is rare, a mutex is enough.
+class Registry {
+public:
+    static Registry& Get() {
+        static Registry* registry = new Registry;
+        return *registry;
+    }
+
+    void Add(Record* record) {
+        std::lock_guard lock(mutex_);
+        record->prev = nullptr;
+        record->next = head_;
+        if (head_) {
+            head_->prev = record;
+        }
+        head_ = record;
+        ++size_;
+    }
+
+    void Remove(Record* record) {
+        std::lock_guard lock(mutex_);
+        (record->prev ? record->prev->next : head_) = record->next;
+        if (record->next) {
+            record->next->prev = record->prev;
+        }
+        --size_;
+    }
+
+    size_t NumLiveSamples() {
+        std::lock_guard lock(mutex_);
+        return size_;
+    }
+
+    void PrintReport(FILE* out) {
+        struct Site {
+            size_t samples = 0;
+            size_t bytes = 0;
+            size_t estimated_bytes = 0;
+        };
+        std::map<std::vector<void*>, Site> sites;
+        std::lock_guard lock(mutex_);
+        for (const Record* record = head_; record; record = record->next) {
+            Site& site = sites[{record->frames, record->frames + record->depth}];
+            ++site.samples;
+            site.bytes += record->bytes;
+            site.estimated_bytes += record->bytes * record->rate;
+        }
+        std::vector<std::pair<std::vector<void*>, Site>> ranked(sites.begin(), sites.end());
+        std::sort(ranked.begin(), ranked.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.second.estimated_bytes > rhs.second.estimated_bytes;
+        });
+
+        std::fprintf(out, "live sampled objects by creation site, %zu sites\n", ranked.size());
+        for (size_t i = 0; i < ranked.size(); ++i) {
+            const auto& [frames, site] = ranked[i];
+            std::fprintf(out, "site %zu: %zu samples, %zu bytes sampled, ~%zu bytes live\n",
+                         i + 1, site.samples, site.bytes, site.estimated_bytes);
+            std::fflush(out);
+            backtrace_symbols_fd(frames.data(), static_cast<int>(frames.size()), fileno(out));
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    Record* head_ = nullptr;
+    size_t size_ = 0;
+};
+
+inline size_t NumLiveSamples() {
+    return Registry::Get().NumLiveSamples();
+}
+
+inline void PrintReport(FILE* out = stderr) {
+    Registry::Get().PrintReport(out);
+}
+
+// Prints the report to stderr on every `signal`. Call it from `main` before starting other
+// threads: they inherit the blocked signal, which a background thread then waits for.
+inline void StartReportOnSignal(int signal = SIGUSR2) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, signal);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    std::thread([signals] {
+        while (true) {
+            int received = 0;
+            if (sigwait(&signals, &received) == 0) {
+                PrintReport(stderr);
+            }
+        }
+    }).detach();
+}
+
+// The sample slot of one object: empty unless the object was picked.
+class Sample {
+public:
+    Sample() = default;
+    // A copy of an object is not the sampled object.
+    Sample(const Sample&) {
+    }
+    Sample& operator=(const Sample&) {
+        return *this;
+    }
+    ~Sample() {
+        Release();
+    }
+
+    // Samples the current stack with probability 1 / `SampleRate()`. `bytes` is what the
+    // object holds on the heap.
+    void Take(size_t bytes) {
+        if (--countdown > 0) [[likely]] {
+            return;
+        }
+        size_t rate = SampleRate();
+        bool first = countdown < 0;
+        countdown = NextInterval(rate);
+        // The first creation of a thread only starts its countdown.
+        if (!first) {
+            Capture(bytes, rate);
+        }
+    }
+
+    // When the object is destroyed.
+    void Release() {
+        if (record_) {
+            Registry::Get().Remove(record_);
+            delete record_;
+            record_ = nullptr;
+        }
+    }
+
+private:
+    // Uniform in [1, 2 * rate - 1]: one sample every `rate` creations on average.
+    static int64_t NextInterval(size_t rate) {
+        thread_local uint64_t state =
+            std::hash<std::thread::id>{}(std::this_thread::get_id()) | 1;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return rate == 1 ? 1 : 1 + static_cast<int64_t>(state % (2 * rate - 1));
+    }
+
+    [[gnu::noinline]] void Capture(size_t bytes, size_t rate) {
+        Release();
+        auto* record = new Record{};
+        record->depth = backtrace(record->frames, kMaxFrames);
+        // Skip `Capture` itself.
+        if (record->depth > 0) {
+            std::memmove(record->frames, record->frames + 1,
+                         sizeof(void*) * (record->depth - 1));
+            --record->depth;
+        }
+        record->bytes = bytes;
+        record->rate = rate;
+        Registry::Get().Add(record);
+        record_ = record;
+    }
+
+    static inline constinit thread_local int64_t countdown = 0;
+
+    Record* record_ = nullptr;
+};
+
+}  // namespace site_profiler
+
+#else
+
+namespace site_profiler {
+
+class Sample {
+public:
+    void Take(size_t) {
+    }
+    void Release() {
+    }
+};
+
+}  // namespace site_profiler
+
+#endif
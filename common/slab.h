@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <utility>
+
+// Allocator of fixed-size chunks for small objects created and destroyed at a high rate, like
+// control blocks.
+//
+// Every thread allocates from and frees to its own free list, so the fast path touches no
+// shared memory. A thread whose list runs out takes the chunks left by exited threads, or
+// carves a new slab of `kChunksPerSlab` chunks with a single heap allocation. A chunk freed by
+// another thread than the one that allocated it joins the freeing thread's list. A list longer
+// than `kMaxLocalChunks` gives a batch of `kChunksPerSlab` chunks back to a global depot, where
+// the next thread to run out takes it: a thread that only frees chunks allocated by others does
+// not hoard them while those others carve new slabs.
+//
+// Slabs are never returned to the system: they stay reachable for leak checkers, and objects
+// destroyed during static destruction can still free their chunks.
+template <size_t Size, size_t Align>
+class SlabAllocator {
+public:
+    static void* Allocate() {
+        if (thread_exited) {
+            return GetGlobal().Take();
+        }
+        FreeList& list = Local();
+        if (!list.head) {
+            list.head = GetGlobal().Refill(&list.size);
+        }
+        Chunk* chunk = list.head;
+        list.head = chunk->next;
+        --list.size;
+        return chunk;
+    }
+
+    static void Deallocate(void* ptr) {
+        auto chunk = static_cast<Chunk*>(ptr);
+        if (thread_exited) {
+            chunk->next = nullptr;
+            GetGlobal().Give(chunk, 1);
+            return;
+        }
+        FreeList& list = Local();
+        chunk->next = list.head;
+        list.head = chunk;
+        if (++list.size > kMaxLocalChunks) [[unlikely]] {
+            list.GiveBatch();
+        }
+    }
+
+    // Slabs carved so far, by all threads.
+    static size_t NumSlabs() {
+        return GetGlobal().NumSlabs();
+    }
+
+private:
+    struct Chunk {
+        Chunk* next;
+        // In the first chunk of a batch in the depot: the next batch and the length of this one.
+        Chunk* next_batch;
+        size_t batch_size;
+    };
+
+    static constexpr size_t kAlign = std::max(Align, alignof(Chunk));
+    static constexpr size_t kChunkSize =
+        (std::max(Size, sizeof(Chunk)) + kAlign - 1) / kAlign * kAlign;
+    static constexpr size_t kChunksPerSlab = 64;
+    static constexpr size_t kMaxLocalChunks = 2 * kChunksPerSlab;
+
+    class Global {
+    public:
+        // A batch from the depot, or a new slab. Sets `*size` to its length.
+        Chunk* Refill(size_t* size) {
+            {
+                std::lock_guard lock(mutex_);
+                if (batches_) {
+                    Chunk* batch = std::exchange(batches_, batches_->next_batch);
+                    *size = batch->batch_size;
+                    return batch;
+                }
+            }
+            auto slab = static_cast<std::byte*>(
+                ::operator new(kChunkSize * kChunksPerSlab, std::align_val_t{kAlign}));
+            for (size_t i = 0; i < kChunksPerSlab; ++i) {
+                auto chunk = reinterpret_cast<Chunk*>(slab + i * kChunkSize);
+                chunk->next = i + 1 < kChunksPerSlab
+                                  ? reinterpret_cast<Chunk*>(slab + (i + 1) * kChunkSize)
+                                  : nullptr;
+            }
+            std::lock_guard lock(mutex_);
+            slabs_ = new SlabNode{slab, slabs_};
+            ++num_slabs_;
+            *size = kChunksPerSlab;
+            return reinterpret_cast<Chunk*>(slab);
+        }
+
+        // One chunk, for threads whose list is already destroyed.
+        Chunk* Take() {
+            size_t size = 0;
+            Chunk* chunk = Refill(&size);
+            if (size > 1) {
+                Give(chunk->next, size - 1);
+            }
+            return chunk;
+        }
+
+        // `size` chunks from `first` on, the last one ending the list.
+        void Give(Chunk* first, size_t size) {
+            std::lock_guard lock(mutex_);
+            first->next_batch = batches_;
+            first->batch_size = size;
+            batches_ = first;
+        }
+
+        size_t NumSlabs() {
+            std::lock_guard lock(mutex_);
+            return num_slabs_;
+        }
+
+    private:
+        struct SlabNode {
+            std::byte* slab;
+            SlabNode* next;
+        };
+
+        std::mutex mutex_;
+        Chunk* batches_ = nullptr;
+        SlabNode* slabs_ = nullptr;
+        size_t num_slabs_ = 0;
+    };
+
+    struct FreeList {
+        // `GetGlobal()` first, so that it is there when the thread exits.
+        FreeList() {
+            GetGlobal();
+        }
+        ~FreeList() {
+            thread_exited = true;
+            if (head) {
+                GetGlobal().Give(head, size);
+            }
+        }
+
+        // Leaves the first `kChunksPerSlab` chunks, the most recently freed ones, to the depot.
+        void GiveBatch() {
+            Chunk* last = head;
+            for (size_t i = 1; i < kChunksPerSlab; ++i) {
+                last = last->next;
+            }
+            Chunk* batch = std::exchange(head, last->next);
+            last->next = nullptr;
+            size -= kChunksPerSlab;
+            GetGlobal().Give(batch, kChunksPerSlab);
+        }
+
+        Chunk* head = nullptr;
+        size_t size = 0;
+    };
+
+    inline static thread_local bool thread_exited = false;
+
+    static Global& GetGlobal() {
+        static Global* global = new Global;
+        return *global;
+    }
+
+    static FreeList& Local() {
+        static thread_local FreeList list;
+        return list;
+    }
+};
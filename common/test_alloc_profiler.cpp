@@ -0,0 +1,170 @@
+#include "alloc_profiler.h"
+#include "bench.h"
+
+#include <intrusive/intrusive.h>
+#include <weak/shared.h>
+#include <weak/weak.h>
+
+#include <catch.hpp>
+
+#include <cstdint>
+#include <new>
+#include <thread>
+#include <vector>
+
+using alloc_profiler::AllocationScope;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Node : public SimpleRefCounted<Node> {
+    int value = 1;
+};
+
+struct alignas(128) OverAligned {
+    char data[128];
+};
+
+// Keeps the compiler from eliding a new/delete pair.
+template <typename T>
+void NewDelete(T* ptr, bool array = false) {
+    DoNotOptimize(ptr);
+    if (array) {
+        delete[] ptr;
+    } else {
+        delete ptr;
+    }
+}
+
+}  // namespace
+
+TEST_CASE("Scope counts allocations and bytes") {
+    AllocationScope scope;
+    void* small = ::operator new(8);
+    void* large = ::operator new(1000);
+
+    auto stats = scope.Stats();
+    REQUIRE(stats.allocations == 2);
+    REQUIRE(stats.deallocations == 0);
+    REQUIRE(stats.allocated_bytes >= 1008);
+    REQUIRE(stats.LiveBytes() == static_cast<int64_t>(stats.allocated_bytes));
+    REQUIRE(stats.size_classes[3] == 1);
+    REQUIRE(stats.size_classes[10] == 1);
+
+    ::operator delete(small);
+    ::operator delete(large);
+    stats = scope.Stats();
+    REQUIRE(stats.deallocations == 2);
+    REQUIRE(stats.LiveBytes() == 0);
+    REQUIRE(stats.peak_live_bytes == static_cast<int64_t>(stats.allocated_bytes));
+}
+
+TEST_CASE("Every variant of operator new is counted") {
+    AllocationScope scope;
+    NewDelete(new int(1));
+    NewDelete(new int[4], true);
+    NewDelete(new (std::nothrow) int(2));
+    auto* aligned = new OverAligned;
+    REQUIRE(reinterpret_cast<uintptr_t>(aligned) % alignof(OverAligned) == 0);
+    NewDelete(aligned);
+    NewDelete(new OverAligned[2], true);
+
+    auto stats = scope.Stats();
+    REQUIRE(stats.allocations == 5);
+    REQUIRE(stats.deallocations == 5);
+    REQUIRE(stats.LiveBytes() == 0);
+}
+
+TEST_CASE("Nested scopes") {
+    AllocationScope outer;
+    auto* first = new std::vector<int>(100);
+    {
+        AllocationScope inner;
+        delete first;
+        auto* second = new int(2);
+
+        auto stats = inner.Stats();
+        REQUIRE(stats.allocations == 1);
+        REQUIRE(stats.deallocations == 2);
+        REQUIRE(stats.LiveBytes() < 0);
+        REQUIRE(stats.peak_live_bytes == 0);
+        delete second;
+    }
+    auto stats = outer.Stats();
+    REQUIRE(stats.allocations == 3);
+    REQUIRE(stats.deallocations == 3);
+    REQUIRE(stats.peak_live_bytes >= static_cast<int64_t>(100 * sizeof(int)));
+}
+
+TEST_CASE("Scopes and thread stats ignore other threads") {
+    auto global_before = alloc_profiler::GlobalStats();
+    AllocationScope scope;
+    std::thread thread([] {
+        for (int i = 0; i < 10; ++i) {
+            NewDelete(new int(i));
+        }
+    });
+    thread.join();
+
+    REQUIRE(scope.Stats().allocations <= 1);
+    REQUIRE(alloc_profiler::GlobalStats().allocations - global_before.allocations >= 10);
+}
+
+TEST_CASE("Stats of every thread, the exited ones too") {
+    uint64_t first_thread_number = 0;
+    std::thread thread([&first_thread_number] {
+        for (int i = 0; i < 10; ++i) {
+            NewDelete(new int(i));
+        }
+        first_thread_number = alloc_profiler::AllThreadStats().back().number;
+    });
+    thread.join();
+
+    auto threads = alloc_profiler::AllThreadStats();
+    REQUIRE(threads.size() >= 2);
+    REQUIRE(!threads.front().exited);
+    const auto& exited = threads[first_thread_number - 1];
+    REQUIRE(exited.number == first_thread_number);
+    REQUIRE(exited.exited);
+    REQUIRE(exited.stats.allocations >= 10);
+}
+
+TEST_CASE("Failed allocations call the new-handler") {
+    static int calls = 0;
+    calls = 0;
+    std::set_new_handler([] {
+        if (++calls == 2) {
+            std::set_new_handler(nullptr);
+        }
+    });
+    volatile size_t huge = SIZE_MAX / 2;
+    REQUIRE_THROWS_AS(::operator new(huge), std::bad_alloc);
+    REQUIRE(calls == 2);
+
+    calls = 0;
+    std::set_new_handler([] {
+        if (++calls == 3) {
+            std::set_new_handler(nullptr);
+        }
+    });
+    REQUIRE(::operator new(huge, std::nothrow) == nullptr);
+    REQUIRE(calls == 3);
+}
+
+TEST_CASE("Steady state copies do not allocate") {
+    auto shared = MakeShared<int>(42);
+    WeakPtr<int> weak(shared);
+    auto intrusive = MakeIntrusive<Node>();
+
+    AllocationScope scope;
+    int sum = 0;
+    for (int i = 0; i < 1000; ++i) {
+        SharedPtr<int> copy = shared;
+        SharedPtr<int> locked = weak.Lock();
+        IntrusivePtr<Node> intrusive_copy = intrusive;
+        sum += *copy + *locked + intrusive_copy->value;
+    }
+    REQUIRE(scope.Stats().allocations == 0);
+    REQUIRE(sum == 85'000);
+}
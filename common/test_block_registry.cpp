@@ -0,0 +1,98 @@
+#include "block_registry.h"
+
+#include <weak/shared.h>
+#include <weak/weak.h>
+
+#include <catch.hpp>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Built with SMART_PTR_TRACK_BLOCKS.
+
+using block_registry::Snapshot;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Tracked {
+    char data[24];
+};
+
+const Snapshot::Type& TypeOf(const Snapshot& snapshot, const std::string& name) {
+    static const Snapshot::Type kNone;
+    auto it = snapshot.Types().find(name);
+    return it == snapshot.Types().end() ? kNone : it->second;
+}
+
+}  // namespace
+
+TEST_CASE("Snapshot counts live blocks and references by type") {
+    auto before = Snapshot::Take();
+    auto first = MakeShared<Tracked>();
+    auto copy = first;
+    SharedPtr<Tracked> second(new Tracked);
+    WeakPtr<Tracked> weak(second);
+    auto array = MakeShared<int[]>(10);
+
+    auto snapshot = Snapshot::Take();
+    const auto& tracked = TypeOf(snapshot, "(anonymous namespace)::Tracked");
+    REQUIRE(tracked.object_size == sizeof(Tracked));
+    REQUIRE(tracked.blocks == 2);
+    REQUIRE(tracked.shared_refs == 3);
+    REQUIRE(tracked.weak_refs == 1);
+    REQUIRE(tracked.expired == 0);
+    REQUIRE(TypeOf(snapshot, "int []").blocks == 1);
+
+    first.Reset();
+    copy.Reset();
+    second.Reset();
+    auto after = Snapshot::Take();
+    const auto& expired = TypeOf(after, "(anonymous namespace)::Tracked");
+    REQUIRE(expired.blocks == 1);
+    REQUIRE(expired.expired == 1);
+    REQUIRE(expired.weak_refs == 1);
+
+    auto diff = Snapshot::Diff(before, after);
+    REQUIRE(diff.Types().size() == 2);
+    REQUIRE(TypeOf(diff, "(anonymous namespace)::Tracked").expired == 1);
+    REQUIRE(TypeOf(diff, "int []").blocks == 1);
+
+    weak.Reset();
+    array.Reset();
+    REQUIRE(Snapshot::Diff(before, Snapshot::Take()).Types().empty());
+}
+
+TEST_CASE("Blocks freed by other threads leave the registry") {
+    auto before = Snapshot::Take();
+    std::vector<SharedPtr<Tracked, AtomicCounter>> ptrs;
+    std::thread thread([&ptrs] {
+        for (int i = 0; i < 100; ++i) {
+            ptrs.push_back(MakeShared<Tracked, AtomicCounter>());
+        }
+    });
+    thread.join();
+    REQUIRE(TypeOf(Snapshot::Diff(before, Snapshot::Take()), "(anonymous namespace)::Tracked")
+                .blocks == 100);
+
+    ptrs.clear();
+    REQUIRE(Snapshot::Diff(before, Snapshot::Take()).Types().empty());
+}
+
+TEST_CASE("Snapshot exports JSON") {
+    auto ptr = MakeShared<Tracked>();
+    FILE* file = std::tmpfile();
+    Snapshot::Take().WriteJson(file);
+    std::string json(std::ftell(file), '\0');
+    std::rewind(file);
+    json.resize(std::fread(json.data(), 1, json.size(), file));
+    std::fclose(file);
+
+    REQUIRE(json.starts_with("{\"types\": ["));
+    REQUIRE(json.find("\"type\": \"(anonymous namespace)::Tracked\", \"object_size\": 24, "
+                      "\"blocks\": 1, \"expired\": 0, \"shared_refs\": 1, \"weak_refs\": 0") !=
+            std::string::npos);
+}
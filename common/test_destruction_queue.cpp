@@ -0,0 +1,147 @@
+#include "destruction_queue.h"
+
+#include <common/packed_counter.h>
+#include <intrusive/intrusive.h>
+#include <weak/shared.h>
+#include <weak/weak.h>
+
+#include <catch.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+std::vector<std::string> destroyed;
+
+struct TreeNode : public SimpleRefCounted<TreeNode, DeferredDelete> {
+    IntrusivePtr<TreeNode> left;
+    IntrusivePtr<TreeNode> right;
+
+    ~TreeNode() {
+        destroyed.push_back("tree");
+    }
+};
+
+IntrusivePtr<TreeNode> MakeTree(int depth) {
+    auto node = MakeIntrusive<TreeNode>();
+    if (depth > 1) {
+        node->left = MakeTree(depth - 1);
+        node->right = MakeTree(depth - 1);
+    }
+    return node;
+}
+
+struct Leaf : public SimpleRefCounted<Leaf, DeferredDelete> {
+    ~Leaf() {
+        destroyed.push_back("leaf");
+    }
+};
+
+struct Slow : public SimpleRefCounted<Slow, DeferredDelete> {
+    ~Slow() {
+        std::this_thread::sleep_for(1ms);
+    }
+};
+
+struct Widget {
+    ~Widget() {
+        destroyed.push_back("widget");
+    }
+};
+
+// Starts from an empty queue.
+DestructionQueue& Queue() {
+    DestructionQueue::Get().Drain();
+    destroyed.clear();
+    return DestructionQueue::Get();
+}
+
+}  // namespace
+
+template <>
+struct DeferDestruction<Widget> : std::true_type {};
+
+// Destroyed at exit after the queue has been drained for the last time.
+SharedPtr<Widget> static_widget = MakeShared<Widget>();
+
+TEST_CASE("Intrusive trees are destroyed level by level") {
+    DestructionQueue& queue = Queue();
+    uint64_t enqueued = queue.GetMetrics().enqueued;
+
+    MakeTree(4);
+    REQUIRE(destroyed.empty());
+    REQUIRE(queue.GetMetrics().depth == 1);
+
+    // The root drops its children, which wait for the next drain.
+    REQUIRE(queue.Drain({.count = 1}) == 1);
+    REQUIRE(destroyed.size() == 1);
+    REQUIRE(queue.GetMetrics().depth == 2);
+
+    REQUIRE(queue.Drain() == 14);
+    REQUIRE(destroyed.size() == 15);
+    auto metrics = queue.GetMetrics();
+    REQUIRE(metrics.depth == 0);
+    REQUIRE(metrics.backlog_age == 0ns);
+    REQUIRE(metrics.enqueued - enqueued == 15);
+}
+
+TEST_CASE("Batches are grouped by type") {
+    DestructionQueue& queue = Queue();
+    for (int i = 0; i < 3; ++i) {
+        MakeIntrusive<Leaf>();
+        MakeIntrusive<TreeNode>();
+    }
+    REQUIRE(queue.Drain() == 6);
+    std::vector<std::string> leaves_first = {"leaf", "leaf", "leaf", "tree", "tree", "tree"};
+    std::vector<std::string> trees_first = {"tree", "tree", "tree", "leaf", "leaf", "leaf"};
+    REQUIRE((destroyed == leaves_first || destroyed == trees_first));
+}
+
+TEST_CASE("Time budget") {
+    DestructionQueue& queue = Queue();
+    for (int i = 0; i < 20; ++i) {
+        MakeIntrusive<Slow>();
+    }
+    std::this_thread::sleep_for(1ms);
+    REQUIRE(queue.GetMetrics().backlog_age >= 1ms);
+
+    size_t first = queue.Drain({.time = 5ms});
+    REQUIRE(first >= 1);
+    REQUIRE(first < 20);
+    REQUIRE(queue.GetMetrics().depth == 20 - first);
+    // A spent budget still makes progress.
+    REQUIRE(queue.Drain({.time = 0ns}) == 1);
+    REQUIRE(queue.Drain() == 19 - first);
+}
+
+TEMPLATE_TEST_CASE("SharedPtr defers types that ask for it", "", SimpleCounter, AtomicCounter,
+                   PackedCounter) {
+    DestructionQueue& queue = Queue();
+    auto made = MakeShared<Widget, TestType>();
+    SharedPtr<Widget, TestType> pointed(new Widget);
+    WeakPtr<Widget, TestType> weak(made);
+
+    made.Reset();
+    pointed.Reset();
+    REQUIRE(weak.Expired());
+    REQUIRE(!weak.Lock());
+    REQUIRE(destroyed.empty());
+    REQUIRE(queue.GetMetrics().depth == 2);
+
+    REQUIRE(queue.Drain() == 2);
+    REQUIRE(destroyed.size() == 2);
+    // The block outlives the object while weak pointers remain.
+    REQUIRE(weak.Expired());
+    weak.Reset();
+
+    // Other types are destroyed at once.
+    MakeShared<std::string, TestType>("abc");
+    REQUIRE(queue.GetMetrics().depth == 0);
+}
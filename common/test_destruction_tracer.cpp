@@ -0,0 +1,95 @@
+#include "destruction_tracer.h"
+
+#include <intrusive/intrusive.h>
+#include <weak/shared.h>
+
+#include <catch.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+// Built with SMART_PTR_TRACE_DESTRUCTION.
+
+using destruction_tracer::Histogram;
+using destruction_tracer::StatsOf;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct ListNode {
+    SharedPtr<ListNode> next;
+};
+
+struct Slow {
+    ~Slow() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+};
+
+struct TreeNode : public SimpleRefCounted<TreeNode> {
+    IntrusivePtr<TreeNode> left;
+    IntrusivePtr<TreeNode> right;
+};
+
+IntrusivePtr<TreeNode> MakeTree(int depth) {
+    auto node = MakeIntrusive<TreeNode>();
+    if (depth > 1) {
+        node->left = MakeTree(depth - 1);
+        node->right = MakeTree(depth - 1);
+    }
+    return node;
+}
+
+}  // namespace
+
+TEST_CASE("Histogram percentiles are within a bucket") {
+    Histogram histogram;
+    REQUIRE(histogram.Percentile(50) == 0);
+    for (uint64_t value = 1; value <= 1000; ++value) {
+        histogram.Record(value);
+    }
+    REQUIRE(histogram.Count() == 1000);
+    REQUIRE(histogram.Max() == 1000);
+    REQUIRE(histogram.Percentile(0) == 1);
+    REQUIRE(histogram.Percentile(100) == 1000);
+    for (double percentile : {10.0, 50.0, 90.0, 99.0}) {
+        auto exact = static_cast<uint64_t>(percentile * 10);
+        REQUIRE(histogram.Percentile(percentile) >= exact);
+        REQUIRE(histogram.Percentile(percentile) <= exact + exact / 16);
+    }
+}
+
+TEST_CASE("Destructions are timed per pointee type") {
+    for (int i = 0; i < 3; ++i) {
+        MakeShared<Slow>();
+    }
+    SharedPtr<std::string>(new std::string("abc"));
+
+    const Histogram& slow = StatsOf<Slow>().nanoseconds;
+    REQUIRE(slow.Count() == 3);
+    REQUIRE(slow.Percentile(50) >= 2'000'000);
+    REQUIRE(StatsOf<Slow>().cascade.Max() == 1);
+    REQUIRE(StatsOf<std::string>().nanoseconds.Count() == 1);
+}
+
+TEST_CASE("Cascades count the destructions they cause") {
+    SharedPtr<ListNode> head;
+    for (int i = 0; i < 10; ++i) {
+        auto node = MakeShared<ListNode>();
+        node->next = std::move(head);
+        head = std::move(node);
+    }
+    head.Reset();
+    REQUIRE(StatsOf<ListNode>().nanoseconds.Count() == 10);
+    REQUIRE(StatsOf<ListNode>().cascade.Max() == 10);
+    REQUIRE(StatsOf<ListNode>().cascade.Percentile(10) == 1);
+
+    // 15 nodes: the root cascades into all of them, each of the 8 leaves only into itself.
+    MakeTree(4);
+    const Histogram& tree = StatsOf<TreeNode>().cascade;
+    REQUIRE(tree.Count() == 15);
+    REQUIRE(tree.Max() == 15);
+    REQUIRE(tree.Percentile(50) == 1);
+}
@@ -0,0 +1,86 @@
+#include "refcount_profiler.h"
+
+#include <intrusive/intrusive.h>
+#include <weak/shared.h>
+#include <weak/weak.h>
+
+#include <catch.hpp>
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Built with SMART_PTR_PROFILE_REFCOUNTS.
+
+using refcount_profiler::Op;
+using refcount_profiler::Total;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Copied {
+    int value = 0;
+};
+
+struct Locked {
+    int value = 0;
+};
+
+struct Node : public AtomicRefCounted<Node> {
+    int value = 0;
+};
+
+void TakeByValue(SharedPtr<Copied> ptr) {
+    REQUIRE(ptr->value == 1);
+}
+
+}  // namespace
+
+TEST_CASE("Shared and weak updates are counted per pointee type") {
+    uint64_t add_before = Total<Copied>(Op::kAddShared);
+    uint64_t del_before = Total<Copied>(Op::kDelShared);
+    {
+        auto ptr = MakeShared<Copied>(1);
+        for (int i = 0; i < 10; ++i) {
+            TakeByValue(ptr);
+        }
+        SharedPtr<Copied> moved = std::move(ptr);
+    }
+    REQUIRE(Total<Copied>(Op::kAddShared) - add_before == 10);
+    REQUIRE(Total<Copied>(Op::kDelShared) - del_before == 11);
+
+    auto owner = SharedPtr<Locked>(new Locked);
+    WeakPtr<Locked> weak(owner);
+    for (int i = 0; i < 5; ++i) {
+        REQUIRE(weak.Lock());
+    }
+    owner.Reset();
+    REQUIRE(!weak.Lock());
+    REQUIRE(Total<Locked>(Op::kAddShared) == 5);
+    REQUIRE(Total<Locked>(Op::kDelShared) == 6);
+    REQUIRE(Total<Locked>(Op::kAddWeak) == 1);
+    // The last shared owner dropped the weak reference held by all shared owners.
+    REQUIRE(Total<Locked>(Op::kDelWeak) == 1);
+    weak.Reset();
+    REQUIRE(Total<Locked>(Op::kDelWeak) == 2);
+    REQUIRE(Total<Copied>(Op::kAddWeak) == 0);
+}
+
+TEST_CASE("Intrusive updates from all threads are counted") {
+    auto node = MakeIntrusive<Node>();
+    uint64_t inc_before = Total<Node>(Op::kIncRef);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([node] {
+            for (int j = 0; j < 1000; ++j) {
+                IntrusivePtr<Node> copy = node;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    // Plus the copy captured by each thread.
+    REQUIRE(Total<Node>(Op::kIncRef) - inc_before == 4 * 1001);
+}
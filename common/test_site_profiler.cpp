@@ -0,0 +1,73 @@
+#include "site_profiler.h"
+
+#include <intrusive/intrusive.h>
+#include <weak/shared.h>
+#include <weak/weak.h>
+
+#include <catch.hpp>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Built with SMART_PTR_SAMPLE_SITES.
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Node : public SimpleRefCounted<Node> {
+    int value = 0;
+};
+
+// Every creation after the first one of the thread is sampled.
+void SampleEverything() {
+    site_profiler::SetSampleRate(1);
+    MakeShared<int>(0);
+}
+
+std::string Report() {
+    FILE* file = std::tmpfile();
+    site_profiler::PrintReport(file);
+    std::string report(std::ftell(file), '\0');
+    std::rewind(file);
+    report.resize(std::fread(report.data(), 1, report.size(), file));
+    std::fclose(file);
+    return report;
+}
+
+}  // namespace
+
+TEST_CASE("Samples live as long as their objects") {
+    SampleEverything();
+    size_t before = site_profiler::NumLiveSamples();
+    {
+        auto made = MakeShared<int>(1);
+        SharedPtr<std::string> pointed(new std::string("abc"));
+        auto array = MakeShared<int[]>(100);
+        auto intrusive = MakeIntrusive<Node>();
+        REQUIRE(site_profiler::NumLiveSamples() - before == 4);
+
+        // Weak pointers keep the block, not the object.
+        WeakPtr<int> weak(made);
+        made.Reset();
+        REQUIRE(site_profiler::NumLiveSamples() - before == 3);
+    }
+    REQUIRE(site_profiler::NumLiveSamples() == before);
+}
+
+TEST_CASE("Report groups live samples by site") {
+    SampleEverything();
+    std::vector<SharedPtr<int>> leaked;
+    for (int i = 0; i < 10; ++i) {
+        leaked.push_back(MakeShared<int>(i));
+    }
+    auto other = MakeShared<std::string>("abc");
+
+    std::string report = Report();
+    REQUIRE(report.find("2 sites") != std::string::npos);
+    REQUIRE(report.find("site 1: 10 samples") != std::string::npos);
+    REQUIRE(report.find("site 2: 1 samples") != std::string::npos);
+
+    site_profiler::SetSampleRate(site_profiler::kDefaultSampleRate);
+}
@@ -0,0 +1,65 @@
+#include "hazard.h"
+#include "intrusive.h"
+
+#include <common/bench.h>
+
+#include <cstdio>
+
+// Readers look up entries of a small read-mostly table: through a `HazardGuard`, or by copying
+// the `IntrusivePtr` stored in the table.
+
+namespace {
+
+struct Entry : public RefCounted<Entry, AtomicCounter, DefaultDelete> {
+    explicit Entry(int value) : value(value) {
+    }
+
+    int value;
+};
+
+constexpr size_t kTableSize = 16;
+constexpr std::chrono::milliseconds kDuration{300};
+
+template <typename F>
+double Run(size_t num_threads, F read) {
+    return MeasureThroughput(num_threads, kDuration,
+                             [&](size_t thread_index, const std::atomic<bool>& stop) {
+                                 uint64_t ops = 0;
+                                 size_t index = thread_index;
+                                 while (!stop.load(std::memory_order_relaxed)) {
+                                     DoNotOptimize(read(index++ % kTableSize));
+                                     ++ops;
+                                 }
+                                 return ops;
+                             });
+}
+
+}  // namespace
+
+int main() {
+    std::atomic<Entry*> hazard_table[kTableSize];
+    IntrusivePtr<Entry> intrusive_table[kTableSize];
+    for (size_t i = 0; i < kTableSize; ++i) {
+        auto entry = new Entry(i);
+        entry->IncRef();
+        hazard_table[i] = entry;
+        intrusive_table[i].Reset(entry);
+    }
+
+    std::printf("%8s %18s %18s\n", "threads", "hazard (Mops/s)", "copy (Mops/s)");
+    for (size_t num_threads : ThreadCounts()) {
+        double hazard_ops = Run(num_threads, [&](size_t index) {
+            HazardGuard guard;
+            return guard.Protect(hazard_table[index])->value;
+        });
+        double copy_ops = Run(num_threads, [&](size_t index) {
+            IntrusivePtr<Entry> entry = intrusive_table[index];
+            return entry->value;
+        });
+        std::printf("%8zu %18.2f %18.2f\n", num_threads, hazard_ops / 1e6, copy_ops / 1e6);
+    }
+
+    for (auto& slot : hazard_table) {
+        HazardDomain::Default().Retire(slot.exchange(nullptr));
+    }
+}
@@ -0,0 +1,43 @@
+#include "intrusive.h"
+
+#include <common/bench.h>
+#include <common/sharded_counter.h>
+
+#include <cstdio>
+
+// Every thread copies one global `IntrusivePtr` per operation, like a request handler taking
+// the current routing table.
+
+namespace {
+
+template <typename Counter>
+struct Table : public RefCounted<Table<Counter>, Counter, DefaultDelete> {
+    int version = 1;
+};
+
+constexpr std::chrono::milliseconds kDuration{300};
+
+template <typename Counter>
+double Run(size_t num_threads) {
+    IntrusivePtr<Table<Counter>> global(new Table<Counter>);
+    return MeasureThroughput(num_threads, kDuration, [&](size_t, const std::atomic<bool>& stop) {
+        uint64_t ops = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            IntrusivePtr<Table<Counter>> table = global;
+            DoNotOptimize(table->version);
+            ++ops;
+        }
+        return ops;
+    });
+}
+
+}  // namespace
+
+int main() {
+    std::printf("%8s %18s %18s\n", "threads", "atomic (Mops/s)", "sharded (Mops/s)");
+    for (size_t num_threads : ThreadCounts()) {
+        double atomic_ops = Run<AtomicCounter>(num_threads);
+        double sharded_ops = Run<ShardedCounter<>>(num_threads);
+        std::printf("%8zu %18.2f %18.2f\n", num_threads, atomic_ops / 1e6, sharded_ops / 1e6);
+    }
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Hazard pointers (Michael, "Hazard Pointers: Safe Memory Reclamation for Lock-Free Objects").
+//
+// A reader publishes the pointer it is about to dereference in a hazard record owned by its
+// thread, so reads touch neither the object nor its reference counter. A writer that unlinks
+// an object hands the reference held by the link to `Retire`; it is released only after a scan
+// finds no hazard on the object.
+//
+//     std::atomic<Node*> slot;  // holds one reference to the node
+//
+//     HazardGuard guard;
+//     Node* node = guard.Protect(slot);  // valid until the guard is reset or destroyed
+//
+//     Node* old = slot.exchange(fresh);
+//     HazardDomain::Default().Retire(old);  // calls old->DecRef() later
+class HazardDomain {
+public:
+    using Reclaim = void (*)(void*);
+
+    HazardDomain() : id_(next_id.fetch_add(1, std::memory_order_relaxed)) {
+    }
+    HazardDomain(const HazardDomain&) = delete;
+    HazardDomain& operator=(const HazardDomain&) = delete;
+    // No guards of the domain may be alive. Records cached by live threads are freed by them.
+    ~HazardDomain() {
+        while (!retired_.empty()) {
+            std::vector<Retired> retired;
+            retired.swap(retired_);
+            for (const Retired& item : retired) {
+                item.reclaim(item.ptr);
+            }
+        }
+        Record* record = records_.load(std::memory_order_acquire);
+        while (record) {
+            Record* next = record->next;
+            if (record->state.exchange(kOrphaned, std::memory_order_acq_rel) == kFree) {
+                delete record;
+            }
+            record = next;
+        }
+    }
+
+    static HazardDomain& Default() {
+        static HazardDomain domain;
+        return domain;
+    }
+
+    // Drops one reference to `object` once no hazard points to it. `object` must be the same
+    // pointer the readers protect.
+    template <typename T>
+    void Retire(T* object) {
+        Retire(object, [](void* ptr) { static_cast<T*>(ptr)->DecRef(); });
+    }
+
+    void Retire(void* ptr, Reclaim reclaim) {
+        size_t count;
+        {
+            std::lock_guard lock(mutex_);
+            retired_.push_back({ptr, reclaim});
+            count = retired_.size();
+        }
+        if (count >= kScanThreshold + 2 * num_records_.load(std::memory_order_relaxed)) {
+            Scan();
+        }
+    }
+
+    // Reclaims every retired object no hazard points to.
+    void Scan() {
+        std::vector<Retired> retired;
+        {
+            std::lock_guard lock(mutex_);
+            retired.swap(retired_);
+        }
+        if (retired.empty()) {
+            return;
+        }
+
+        // seq_cst pairs with the store in `HazardGuard::Protect`: either the reader sees the
+        // object unlinked and retries, or we see its hazard.
+        std::vector<const void*> hazards;
+        for (Record* record = records_.load(std::memory_order_acquire); record;
+             record = record->next) {
+            if (const void* hazard = record->hazard.load(std::memory_order_seq_cst)) {
+                hazards.push_back(hazard);
+            }
+        }
+        std::sort(hazards.begin(), hazards.end());
+
+        std::vector<Retired> kept;
+        for (const Retired& item : retired) {
+            if (std::binary_search(hazards.begin(), hazards.end(), item.ptr)) {
+                kept.push_back(item);
+            } else {
+                // Not under the mutex: destroying an object may retire others.
+                item.reclaim(item.ptr);
+            }
+        }
+        if (!kept.empty()) {
+            std::lock_guard lock(mutex_);
+            retired_.insert(retired_.end(), kept.begin(), kept.end());
+        }
+    }
+
+private:
+    friend class HazardGuard;
+
+    enum State : uint8_t { kFree, kUsed, kOrphaned };
+
+    // On its own cache line, so readers of different threads do not share one.
+    struct alignas(64) Record {
+        std::atomic<const void*> hazard = nullptr;
+        std::atomic<State> state = kUsed;
+        Record* next = nullptr;
+    };
+
+    struct Retired {
+        void* ptr;
+        Reclaim reclaim;
+    };
+
+    // Records stay with their thread between guards, so taking a guard touches no shared
+    // cache line.
+    class ThreadCache {
+    public:
+        ~ThreadCache() {
+            for (const Entry& entry : entries_) {
+                Free(entry.record);
+            }
+        }
+
+        Record* Take(uint64_t domain_id) {
+            for (size_t i = 0; i < entries_.size(); ++i) {
+                if (entries_[i].domain_id == domain_id) {
+                    Record* record = entries_[i].record;
+                    entries_[i] = entries_.back();
+                    entries_.pop_back();
+                    return record;
+                }
+            }
+            return nullptr;
+        }
+
+        void Put(uint64_t domain_id, Record* record) {
+            if (entries_.size() == kMaxCached) {
+                DropOrphaned();
+            }
+            if (entries_.size() < kMaxCached) {
+                entries_.push_back({domain_id, record});
+            } else {
+                Free(record);
+            }
+        }
+
+        static ThreadCache& Get() {
+            static thread_local ThreadCache cache;
+            return cache;
+        }
+
+    private:
+        struct Entry {
+            uint64_t domain_id;
+            Record* record;
+        };
+
+        // Records of destroyed domains.
+        void DropOrphaned() {
+            std::erase_if(entries_, [](const Entry& entry) {
+                if (entry.record->state.load(std::memory_order_acquire) != kOrphaned) {
+                    return false;
+                }
+                delete entry.record;
+                return true;
+            });
+        }
+
+        static constexpr size_t kMaxCached = 8;
+
+        std::vector<Entry> entries_;
+    };
+
+    static constexpr size_t kScanThreshold = 64;
+
+    inline static std::atomic<uint64_t> next_id = 0;
+
+    // The domain may be gone already; then the record is ours to delete.
+    static void Free(Record* record) {
+        if (record->state.exchange(kFree, std::memory_order_acq_rel) == kOrphaned) {
+            delete record;
+        }
+    }
+
+    Record* AcquireRecord() {
+        if (Record* record = ThreadCache::Get().Take(id_)) {
+            return record;
+        }
+        for (Record* record = records_.load(std::memory_order_acquire); record;
+             record = record->next) {
+            State state = kFree;
+            if (record->state.load(std::memory_order_relaxed) == kFree &&
+                record->state.compare_exchange_strong(state, kUsed, std::memory_order_acquire)) {
+                return record;
+            }
+        }
+        auto record = new Record;
+        record->next = records_.load(std::memory_order_relaxed);
+        while (!records_.compare_exchange_weak(record->next, record, std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+        }
+        num_records_.fetch_add(1, std::memory_order_relaxed);
+        return record;
+    }
+
+    void ReleaseRecord(Record* record) {
+        ThreadCache::Get().Put(id_, record);
+    }
+
+    // Ids rather than addresses, so a cached record never matches a later domain at the
+    // same address.
+    const uint64_t id_;
+    std::atomic<Record*> records_ = nullptr;
+    std::atomic<size_t> num_records_ = 0;
+    std::mutex mutex_;
+    std::vector<Retired> retired_;
+};
+
+// Protects one pointer at a time from being reclaimed by its `HazardDomain`.
+class HazardGuard {
+public:
+    explicit HazardGuard(HazardDomain& domain = HazardDomain::Default())
+        : domain_(domain), record_(domain.AcquireRecord()) {
+    }
+    HazardGuard(const HazardGuard&) = delete;
+    HazardGuard& operator=(const HazardGuard&) = delete;
+    ~HazardGuard() {
+        Reset();
+        domain_.ReleaseRecord(record_);
+    }
+
+    // Loads `source` and keeps the result alive until the next `Protect` or `Reset`.
+    template <typename T>
+    T* Protect(const std::atomic<T*>& source) {
+        T* ptr = source.load(std::memory_order_relaxed);
+        while (true) {
+            record_->hazard.store(ptr, std::memory_order_seq_cst);
+            // Still linked after the hazard is visible: no scan can miss it.
+            T* current = source.load(std::memory_order_seq_cst);
+            if (current == ptr) {
+                return ptr;
+            }
+            ptr = current;
+        }
+    }
+
+    void Reset() {
+        record_->hazard.store(nullptr, std::memory_order_release);
+    }
+
+private:
+    HazardDomain& domain_;
+    HazardDomain::Record* record_;
+};
@@ -1,41 +1,55 @@
 #pragma once
 
+#include "common/counters.h"
+#include "common/destruction_queue.h"
+#include "common/destruction_tracer.h"
+#include "common/refcount_profiler.h"
+#include "common/site_profiler.h"
+
 #include <cstddef>  // for std::nullptr_t
 #include <utility>  // for std::exchange / std::swap
 
-class SimpleCounter {
-public:
-    size_t IncRef() {
-        return ++count_;
-    }
-    size_t DecRef() {
-        return --count_;
-    }
-    size_t RefCount() const {
-        return count_;
+struct DefaultDelete {
+    template <typename T>
+    static void Destroy(T* object) {
+        delete object;
     }
-
-private:
-    size_t count_ = 0;
 };
 
-struct DefaultDelete {
+// Leaves the object to `DestructionQueue::Drain`, for objects whose destruction may cascade
+// into many others.
+struct DeferredDelete {
     template <typename T>
     static void Destroy(T* object) {
-        delete object;
+        DestructionQueue::Get().Enqueue(&Delete<T>, object, &kType<T>);
+    }
+
+private:
+    template <typename T>
+    static void Delete(void* object) {
+        delete static_cast<T*>(object);
     }
+
+    // The address tells the types apart.
+    template <typename T>
+    static constexpr char kType = 0;
 };
 
 template <typename Derived, typename Counter, typename Deleter>
 class RefCounted {
 public:
     void IncRef() {
+        refcount_profiler::Count<Derived>(refcount_profiler::Op::kIncRef);
         counter_.IncRef();
     }
 
     void DecRef() {
-        counter_.DecRef();
-        if (counter_.RefCount() == 0) {
+        refcount_profiler::Count<Derived>(refcount_profiler::Op::kDecRef);
+        // Test the value returned by the decrement: reading the counter again would let two
+        // threads both see zero.
+        if (counter_.DecRef() == 0) {
+            [[maybe_unused]] destruction_tracer::Trace<Derived> trace;
+            sample_.Release();
             Deleter::Destroy(static_cast<Derived*>(this));
         }
     }
@@ -49,12 +63,22 @@ public:
     }
 
 private:
+    // For `MakeIntrusive`, found by argument-dependent lookup.
+    friend void SampleSite(RefCounted& object, size_t bytes) {
+        object.sample_.Take(bytes);
+    }
+
     Counter counter_;
+    [[no_unique_address]] site_profiler::Sample sample_;
 };
 
 template <typename Derived, typename D = DefaultDelete>
 using SimpleRefCounted = RefCounted<Derived, SimpleCounter, D>;
 
+// For objects shared between threads.
+template <typename Derived, typename D = DefaultDelete>
+using AtomicRefCounted = RefCounted<Derived, AtomicCounter, D>;
+
 template <typename T>
 class IntrusivePtr {
     template <typename Y>
@@ -177,5 +201,10 @@ private:
 
 template <typename T, typename... Args>
 IntrusivePtr<T> MakeIntrusive(Args&&... args) {
-    return IntrusivePtr<T>(new T(std::forward<Args>(args)...));
+    T* object = new T(std::forward<Args>(args)...);
+    // Objects counted by `RefCounted` may be sampled by `site_profiler`.
+    if constexpr (requires { SampleSite(*object, sizeof(T)); }) {
+        SampleSite(*object, sizeof(T));
+    }
+    return IntrusivePtr<T>(object);
 }
@@ -0,0 +1,418 @@
+#pragma once
+
+#include "intrusive.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class ObjectPool;
+
+// `RefCounted::DecRef` reaching zero hands the object back to its pool instead of deleting it.
+struct ReturnToPool {
+    template <typename T>
+    static void Destroy(T* object) {
+        object->home_->Release(object);
+    }
+};
+
+template <typename Derived>
+class ObjectInPool : public RefCounted<Derived, AtomicCounter, ReturnToPool> {
+private:
+    friend struct ReturnToPool;
+    friend class ObjectPool<Derived>;
+
+    ObjectPool<Derived>* home_ = nullptr;
+    // Magazine that handed the object out last, to count cross-thread returns.
+    const void* last_owner_ = nullptr;
+};
+
+struct ObjectPoolStats {
+    size_t allocations = 0;
+    // Allocations served by a recycled object.
+    size_t hits = 0;
+    size_t releases = 0;
+    // Objects released by another thread than the one that allocated them.
+    size_t cross_thread_returns = 0;
+    // Objects constructed by the pool. It never frees them, so they all still exist: in use or
+    // available.
+    size_t created = 0;
+    size_t available = 0;
+    // Most objects in use at once. Sampled when a thread creates objects or takes a batch from
+    // the depot, the only times the number in use can exceed what the magazines already held:
+    // it may miss up to a magazine per thread allocated without going to the depot.
+    size_t peak_in_use = 0;
+
+    double HitRate() const {
+        return allocations ? static_cast<double>(hits) / allocations : 0;
+    }
+};
+
+// Thread-safe pool of recycled objects (Bonwick, Adams, "Magazines and Vmem", USENIX'01).
+//
+// Each thread keeps two batches of free objects per pool (its magazine) and allocates and
+// releases through them without synchronization. Full and empty batches are exchanged with a
+// lock-free depot shared by all threads. Objects released by a thread go to that thread's
+// magazine, whoever allocated them.
+//
+// Recycled objects are handed out as they were released: `args` are only used to construct new
+// objects. The pool must outlive its objects.
+template <typename T>
+class ObjectPool {
+    static_assert(std::is_base_of_v<ObjectInPool<T>, T>, "Unsupported type");
+
+public:
+    ObjectPool() : id_(next_id.fetch_add(1, std::memory_order_relaxed)) {
+    }
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+    ~ObjectPool() {
+        for (Magazine* magazine : magazines_) {
+            {
+                std::lock_guard lock(magazine->mutex);
+                magazine->orphaned = true;
+                for (Batch* batch : {magazine->loaded, magazine->previous}) {
+                    if (batch) {
+                        DeleteObjects(batch);
+                        delete batch;
+                    }
+                }
+            }
+            magazine->Unref();
+        }
+        while (Batch* batch = full_.Pop()) {
+            DeleteObjects(batch);
+            delete batch;
+        }
+        while (Batch* batch = empty_.Pop()) {
+            delete batch;
+        }
+    }
+
+    template <typename... Args>
+    IntrusivePtr<T> Allocate(Args&&... args) {
+        Magazine& magazine = LocalMagazine();
+        Magazine::Add(magazine.allocations, 1);
+        T* object = magazine.Pop(*this);
+        if (object) {
+            Magazine::Add(magazine.hits, 1);
+        } else {
+            object = new T(std::forward<Args>(args)...);
+            object->home_ = this;
+            created_.fetch_add(1, std::memory_order_relaxed);
+            SamplePeak();
+        }
+        object->last_owner_ = &magazine;
+        return IntrusivePtr<T>(object);
+    }
+
+    void Release(T* object) {
+        Magazine& magazine = LocalMagazine();
+        Magazine::Add(magazine.releases, 1);
+        if (object->last_owner_ != &magazine) {
+            Magazine::Add(magazine.cross_thread_returns, 1);
+        }
+        magazine.Push(*this, object);
+    }
+
+    // Exact when no thread is allocating or releasing.
+    size_t NumAvailable() const {
+        return Stats().available;
+    }
+    size_t NumInUse() const {
+        ObjectPoolStats stats = Stats();
+        return stats.created - stats.available;
+    }
+
+    ObjectPoolStats Stats() const {
+        ObjectPoolStats stats;
+        {
+            std::lock_guard lock(mutex_);
+            for (const Magazine* magazine : magazines_) {
+                magazine->AddTo(stats);
+            }
+        }
+        stats.created = created_.load(std::memory_order_relaxed);
+        stats.available += depot_available_.load(std::memory_order_relaxed);
+        stats.peak_in_use = peak_in_use_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    static constexpr size_t kBatchSize = 32;
+
+    struct Batch {
+        std::atomic<Batch*> next = nullptr;
+        size_t size = 0;
+        T* objects[kBatchSize];
+    };
+
+    // Treiber stack. The tag in the top 16 bits of `head_` makes a pop fail if the top batch
+    // was popped and pushed back meanwhile; batches are only freed with the pool, so reading
+    // `next` of a popped batch is safe.
+    class BatchStack {
+    public:
+        void Push(Batch* batch) {
+            uint64_t head = head_.load(std::memory_order_relaxed);
+            do {
+                batch->next.store(GetBatch(head), std::memory_order_relaxed);
+            } while (!head_.compare_exchange_weak(head, Pack(batch, GetTag(head) + 1),
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed));
+        }
+
+        Batch* Pop() {
+            uint64_t head = head_.load(std::memory_order_acquire);
+            while (Batch* batch = GetBatch(head)) {
+                Batch* next = batch->next.load(std::memory_order_relaxed);
+                if (head_.compare_exchange_weak(head, Pack(next, GetTag(head) + 1),
+                                                std::memory_order_acquire,
+                                                std::memory_order_acquire)) {
+                    return batch;
+                }
+            }
+            return nullptr;
+        }
+
+    private:
+        static_assert(sizeof(void*) == sizeof(uint64_t), "Needs 64-bit pointers");
+
+        static constexpr int kTagShift = 48;
+        static constexpr uint64_t kBatchMask = (uint64_t{1} << kTagShift) - 1;
+
+        static Batch* GetBatch(uint64_t head) {
+            return reinterpret_cast<Batch*>(head & kBatchMask);
+        }
+        static uint64_t GetTag(uint64_t head) {
+            return head >> kTagShift;
+        }
+        static uint64_t Pack(Batch* batch, uint64_t tag) {
+            return reinterpret_cast<uint64_t>(batch) | tag << kTagShift;
+        }
+
+        std::atomic<uint64_t> head_ = 0;
+    };
+
+    // One per thread and pool. Shared by the thread (through its `MagazineCache`) and the pool,
+    // freed by whichever lets go of it last. The pool keeps the magazines of exited threads
+    // for their counters.
+    struct Magazine {
+        explicit Magazine(ObjectPool* pool) : pool(pool) {
+        }
+
+        // Only the owning thread writes the counters, other threads read them for `Stats`.
+        static void Add(std::atomic<size_t>& counter, size_t delta) {
+            counter.store(counter.load(std::memory_order_relaxed) + delta,
+                          std::memory_order_relaxed);
+        }
+
+        T* Pop(ObjectPool& pool) {
+            if (loaded->size == 0) {
+                if (previous->size > 0) {
+                    std::swap(loaded, previous);
+                } else if (Batch* full = pool.full_.Pop()) {
+                    // Counted twice for a moment rather than not at all, so that `SamplePeak`
+                    // never overestimates.
+                    Add(available, full->size);
+                    pool.depot_available_.fetch_sub(full->size, std::memory_order_relaxed);
+                    pool.empty_.Push(previous);
+                    previous = loaded;
+                    loaded = full;
+                    T* object = TakeLoaded();
+                    pool.SamplePeak();
+                    return object;
+                } else {
+                    return nullptr;
+                }
+            }
+            return TakeLoaded();
+        }
+
+        T* TakeLoaded() {
+            Add(available, -1);
+            return loaded->objects[--loaded->size];
+        }
+
+        void Push(ObjectPool& pool, T* object) {
+            if (loaded->size == kBatchSize) {
+                if (previous->size == 0) {
+                    std::swap(loaded, previous);
+                } else {
+                    Batch* empty = pool.empty_.Pop();
+                    size_t size = previous->size;
+                    pool.PushFull(previous);
+                    Add(available, -size);
+                    previous = loaded;
+                    loaded = empty ? empty : new Batch;
+                }
+            }
+            loaded->objects[loaded->size++] = object;
+            Add(available, 1);
+        }
+
+        void AddTo(ObjectPoolStats& stats) const {
+            stats.allocations += allocations.load(std::memory_order_relaxed);
+            stats.hits += hits.load(std::memory_order_relaxed);
+            stats.releases += releases.load(std::memory_order_relaxed);
+            stats.cross_thread_returns += cross_thread_returns.load(std::memory_order_relaxed);
+            stats.available += available.load(std::memory_order_relaxed);
+        }
+
+        // The owning thread exits: hand the batches to the depot, unless the pool is gone.
+        void Detach() {
+            {
+                std::lock_guard lock(mutex);
+                if (!orphaned) {
+                    for (Batch* batch : {loaded, previous}) {
+                        if (batch->size > 0) {
+                            pool->PushFull(batch);
+                        } else {
+                            pool->empty_.Push(batch);
+                        }
+                    }
+                    loaded = previous = nullptr;
+                    available.store(0, std::memory_order_relaxed);
+                }
+            }
+            Unref();
+        }
+
+        void Unref() {
+            if (owners.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete this;
+            }
+        }
+
+        ObjectPool* pool;
+        // `previous` is either full or empty.
+        Batch* loaded = new Batch;
+        Batch* previous = new Batch;
+        std::atomic<size_t> available = 0;
+        std::atomic<size_t> allocations = 0;
+        std::atomic<size_t> hits = 0;
+        std::atomic<size_t> releases = 0;
+        std::atomic<size_t> cross_thread_returns = 0;
+
+        // Guards `orphaned` and the batches: the pool and the exiting thread both want them.
+        std::mutex mutex;
+        bool orphaned = false;
+        std::atomic<int> owners = 2;
+    };
+
+    // Magazines of the calling thread, by pool id. Ids rather than addresses, so an entry never
+    // matches a later pool at the same address.
+    class MagazineCache {
+    public:
+        ~MagazineCache() {
+            for (const Entry& entry : entries_) {
+                entry.magazine->Detach();
+            }
+        }
+
+        Magazine* Find(uint64_t pool_id) {
+            if (last_ && last_->pool_id == pool_id) {
+                return last_->magazine;
+            }
+            for (Entry& entry : entries_) {
+                if (entry.pool_id == pool_id) {
+                    last_ = &entry;
+                    return entry.magazine;
+                }
+            }
+            return nullptr;
+        }
+
+        void Add(uint64_t pool_id, Magazine* magazine) {
+            // Drop the magazines of destroyed pools first.
+            std::erase_if(entries_, [](const Entry& entry) {
+                bool orphaned;
+                {
+                    std::lock_guard lock(entry.magazine->mutex);
+                    orphaned = entry.magazine->orphaned;
+                }
+                if (orphaned) {
+                    entry.magazine->Unref();
+                }
+                return orphaned;
+            });
+            last_ = nullptr;
+            entries_.push_back({pool_id, magazine});
+        }
+
+    private:
+        struct Entry {
+            uint64_t pool_id;
+            Magazine* magazine;
+        };
+
+        std::vector<Entry> entries_;
+        Entry* last_ = nullptr;
+    };
+
+    inline static std::atomic<uint64_t> next_id = 0;
+
+    static MagazineCache& Cache() {
+        static thread_local MagazineCache cache;
+        return cache;
+    }
+
+    static void DeleteObjects(Batch* batch) {
+        for (size_t i = 0; i < batch->size; ++i) {
+            delete batch->objects[i];
+        }
+    }
+
+    Magazine& LocalMagazine() {
+        MagazineCache& cache = Cache();
+        if (Magazine* magazine = cache.Find(id_)) {
+            return *magazine;
+        }
+        auto magazine = new Magazine(this);
+        {
+            std::lock_guard lock(mutex_);
+            magazines_.push_back(magazine);
+        }
+        cache.Add(id_, magazine);
+        return *magazine;
+    }
+
+    // Objects in use now: the created ones not in a magazine or the depot.
+    void SamplePeak() {
+        size_t available = depot_available_.load(std::memory_order_relaxed);
+        {
+            std::lock_guard lock(mutex_);
+            for (const Magazine* magazine : magazines_) {
+                available += magazine->available.load(std::memory_order_relaxed);
+            }
+        }
+        size_t created = created_.load(std::memory_order_relaxed);
+        size_t in_use = created > available ? created - available : 0;
+        size_t peak = peak_in_use_.load(std::memory_order_relaxed);
+        while (peak < in_use &&
+               !peak_in_use_.compare_exchange_weak(peak, in_use, std::memory_order_relaxed)) {
+        }
+    }
+
+    void PushFull(Batch* batch) {
+        depot_available_.fetch_add(batch->size, std::memory_order_relaxed);
+        full_.Push(batch);
+    }
+
+    const uint64_t id_;
+    BatchStack full_;
+    BatchStack empty_;
+    std::atomic<size_t> depot_available_ = 0;
+    std::atomic<size_t> created_ = 0;
+    std::atomic<size_t> peak_in_use_ = 0;
+
+    // Guards `magazines_`.
+    mutable std::mutex mutex_;
+    std::vector<Magazine*> magazines_;
+};
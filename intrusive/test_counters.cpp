@@ -0,0 +1,139 @@
+#include "intrusive.h"
+
+#include <common/sharded_counter.h>
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+template <typename Counter>
+struct Object : public RefCounted<Object<Counter>, Counter, DefaultDelete> {
+    Object() {
+        ++alive;
+    }
+    ~Object() {
+        --alive;
+    }
+
+    inline static std::atomic<int> alive = 0;
+};
+
+struct Small : public RefCounted<Small, SaturatingCounter<uint8_t>, DefaultDelete> {
+    uint8_t payload[7];
+};
+
+}  // namespace
+
+TEMPLATE_TEST_CASE("Counter policies", "", SimpleCounter, AtomicCounter,
+                   SaturatingCounter<uint8_t>, SaturatingCounter<uint16_t>,
+                   SaturatingCounter<uint32_t>, AtomicSaturatingCounter<uint8_t>,
+                   AtomicSaturatingCounter<uint16_t>, AtomicSaturatingCounter<uint32_t>,
+                   ShardedCounter<>) {
+    {
+        IntrusivePtr<Object<TestType>> a(new Object<TestType>);
+        auto b = a;
+        REQUIRE(a.UseCount() == 2);
+        b.Reset();
+        REQUIRE(a.UseCount() == 1);
+    }
+    REQUIRE(Object<TestType>::alive == 0);
+}
+
+TEST_CASE("Narrow counters shrink the object") {
+    REQUIRE(sizeof(SaturatingCounter<uint8_t>) == 1);
+    REQUIRE(sizeof(AtomicSaturatingCounter<uint16_t>) == 2);
+    REQUIRE(sizeof(Small) == 8);
+}
+
+TEST_CASE("Saturated counter leaks the object") {
+    using Counter = SaturatingCounter<uint8_t>;
+    auto object = new Object<Counter>;
+    {
+        std::vector<IntrusivePtr<Object<Counter>>> ptrs(300, IntrusivePtr(object));
+        REQUIRE(object->RefCount() == Counter::kSaturated);
+    }
+    REQUIRE(Object<Counter>::alive == 1);
+    REQUIRE(object->RefCount() == Counter::kSaturated);
+    delete object;
+}
+
+TEST_CASE("Saturated atomic counter stays saturated") {
+    using Counter = AtomicSaturatingCounter<uint8_t>;
+    Counter counter(Counter::kSaturated - 1);
+    REQUIRE(counter.IncRef() == Counter::kSaturated);
+    REQUIRE(counter.IncRef() == Counter::kSaturated);
+    REQUIRE(counter.DecRef() == Counter::kSaturated);
+    REQUIRE(counter.IncRefIfNonZero());
+    REQUIRE(counter.RefCount() == Counter::kSaturated);
+}
+
+TEST_CASE("Atomic counter saturates through IncRefIfNonZero") {
+    using Counter = AtomicSaturatingCounter<uint8_t>;
+    Counter counter(1);
+    for (size_t i = 1; i < Counter::kSaturated; ++i) {
+        REQUIRE(counter.IncRefIfNonZero());
+        REQUIRE(counter.RefCount() == i + 1);
+    }
+    REQUIRE(counter.RefCount() == Counter::kSaturated);
+    REQUIRE(counter.IncRefIfNonZero());
+    REQUIRE(counter.RefCount() == Counter::kSaturated);
+    REQUIRE(counter.DecRef() == Counter::kSaturated);
+}
+
+TEMPLATE_TEST_CASE("Concurrent IntrusivePtr copies", "", AtomicCounter,
+                   AtomicSaturatingCounter<uint16_t>, ShardedCounter<>, ShardedCounter<2>) {
+    constexpr size_t kNumThreads = 4;
+    constexpr int kNumIters = 20000;
+
+    for (int round = 0; round < 10; ++round) {
+        std::vector<IntrusivePtr<Object<TestType>>> ptrs(kNumThreads,
+                                                         IntrusivePtr(new Object<TestType>));
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < kNumThreads; ++i) {
+            threads.emplace_back([&ptrs, i] {
+                IntrusivePtr<Object<TestType>> mine = std::move(ptrs[i]);
+                for (int j = 0; j < kNumIters; ++j) {
+                    auto copy = mine;
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(Object<TestType>::alive == 0);
+    }
+}
+
+TEST_CASE("Sharded counter with copies on many threads") {
+    using Counter = ShardedCounter<4>;
+    constexpr size_t kNumThreads = 8;
+
+    IntrusivePtr<Object<Counter>> global(new Object<Counter>);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < kNumThreads; ++i) {
+        threads.emplace_back([&global] {
+            for (int j = 0; j < 10000; ++j) {
+                auto first = global;
+                auto second = first;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(global.UseCount() == 1);
+
+    // Copied on this thread, released on another one.
+    auto copy = global;
+    global.Reset();
+    REQUIRE(Object<Counter>::alive == 1);
+    std::thread([copy = std::move(copy)]() mutable { copy.Reset(); }).join();
+    REQUIRE(Object<Counter>::alive == 0);
+}
@@ -0,0 +1,122 @@
+#include "hazard.h"
+#include "intrusive.h"
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Node : public RefCounted<Node, AtomicCounter, DefaultDelete> {
+    explicit Node(int value) : value(value) {
+        IncRef();
+        ++alive;
+    }
+    ~Node() {
+        value = 0;
+        --alive;
+    }
+
+    int value;
+
+    inline static std::atomic<int> alive = 0;
+};
+
+}  // namespace
+
+TEST_CASE("Hazard protects a retired object") {
+    {
+        HazardDomain domain;
+        std::atomic<Node*> slot = new Node(1);
+
+        HazardGuard guard(domain);
+        Node* node = guard.Protect(slot);
+        REQUIRE(node->value == 1);
+
+        domain.Retire(slot.exchange(new Node(2)));
+        domain.Scan();
+        REQUIRE(Node::alive == 2);
+        REQUIRE(node->value == 1);
+
+        guard.Reset();
+        domain.Scan();
+        REQUIRE(Node::alive == 1);
+
+        REQUIRE(guard.Protect(slot)->value == 2);
+        domain.Retire(slot.exchange(nullptr));
+    }
+    REQUIRE(Node::alive == 0);
+}
+
+TEST_CASE("Retire drops one reference") {
+    HazardDomain domain;
+    std::atomic<Node*> slot = new Node(1);
+    IntrusivePtr<Node> kept;
+    {
+        HazardGuard guard(domain);
+        kept.Reset(guard.Protect(slot));
+        REQUIRE(kept.UseCount() == 2);
+    }
+    domain.Retire(slot.exchange(nullptr));
+    domain.Scan();
+    REQUIRE(kept.UseCount() == 1);
+    REQUIRE(kept->value == 1);
+    kept.Reset();
+    REQUIRE(Node::alive == 0);
+}
+
+TEST_CASE("Guards in several domains") {
+    HazardDomain first, second;
+    std::atomic<Node*> slot = new Node(1);
+    {
+        HazardGuard a(first);
+        HazardGuard b(second);
+        HazardGuard c(first);
+        REQUIRE(a.Protect(slot) == b.Protect(slot));
+        REQUIRE(c.Protect(slot) == a.Protect(slot));
+    }
+    first.Retire(slot.exchange(nullptr));
+    first.Scan();
+    REQUIRE(Node::alive == 0);
+}
+
+TEST_CASE("Readers and a writer") {
+    constexpr size_t kNumReaders = 4;
+    constexpr int kNumVersions = 5000;
+
+    {
+        HazardDomain domain;
+        std::atomic<Node*> slot = new Node(0);
+        std::atomic<bool> done = false;
+        std::atomic<bool> ordered = true;
+
+        std::vector<std::thread> readers;
+        for (size_t i = 0; i < kNumReaders; ++i) {
+            readers.emplace_back([&] {
+                int last = 0;
+                while (!done) {
+                    HazardGuard guard(domain);
+                    int value = guard.Protect(slot)->value;
+                    if (value < last) {
+                        ordered = false;
+                    }
+                    last = value;
+                }
+            });
+        }
+        for (int version = 1; version <= kNumVersions; ++version) {
+            domain.Retire(slot.exchange(new Node(version)));
+        }
+        done = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        domain.Retire(slot.exchange(nullptr));
+        REQUIRE(ordered);
+    }
+    REQUIRE(Node::alive == 0);
+}
@@ -0,0 +1,153 @@
+#include "object_pool.h"
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Buffer : ObjectInPool<Buffer> {
+    Buffer() {
+        ++alive;
+    }
+    ~Buffer() {
+        --alive;
+    }
+
+    int owner = -1;
+
+    inline static std::atomic<int> alive = 0;
+};
+
+}  // namespace
+
+TEST_CASE("Pool statistics") {
+    {
+        ObjectPool<Buffer> pool;
+        {
+            auto a = pool.Allocate();
+            auto b = pool.Allocate();
+        }
+        auto c = pool.Allocate();
+
+        ObjectPoolStats stats = pool.Stats();
+        REQUIRE(stats.allocations == 3);
+        REQUIRE(stats.hits == 1);
+        REQUIRE(stats.releases == 2);
+        REQUIRE(stats.cross_thread_returns == 0);
+        REQUIRE(stats.created == 2);
+        REQUIRE(stats.available == 1);
+        REQUIRE(stats.peak_in_use == 2);
+        REQUIRE(stats.HitRate() == Approx(1.0 / 3));
+        REQUIRE(pool.NumInUse() == 1);
+    }
+    REQUIRE(Buffer::alive == 0);
+}
+
+TEST_CASE("Objects move between threads through the depot") {
+    constexpr size_t kCount = 1000;
+    {
+        ObjectPool<Buffer> pool;
+        std::vector<IntrusivePtr<Buffer>> buffers;
+        for (size_t i = 0; i < kCount; ++i) {
+            buffers.push_back(pool.Allocate());
+        }
+        std::thread([&] { buffers.clear(); }).join();
+
+        ObjectPoolStats stats = pool.Stats();
+        REQUIRE(stats.cross_thread_returns == kCount);
+        REQUIRE(stats.available == kCount);
+        REQUIRE(stats.peak_in_use == kCount);
+
+        // The releasing thread is gone, its batches went to the depot.
+        for (size_t i = 0; i < kCount; ++i) {
+            buffers.push_back(pool.Allocate());
+        }
+        REQUIRE(pool.Stats().created == kCount);
+        REQUIRE(pool.NumAvailable() == 0);
+        // Taken back from the depot: as many in use as before, not twice as many.
+        REQUIRE(pool.Stats().peak_in_use == kCount);
+        buffers.clear();
+        for (size_t i = 0; i < 2 * kCount; ++i) {
+            buffers.push_back(pool.Allocate());
+        }
+        REQUIRE(pool.Stats().peak_in_use == 2 * kCount);
+    }
+    REQUIRE(Buffer::alive == 0);
+}
+
+TEST_CASE("Pool destroyed before a thread that used it") {
+    auto pool = std::make_unique<ObjectPool<Buffer>>();
+    std::atomic<int> stage = 0;
+    std::thread thread([&] {
+        pool->Allocate();
+        stage = 1;
+        while (stage != 2) {
+            std::this_thread::yield();
+        }
+    });
+    while (stage != 1) {
+        std::this_thread::yield();
+    }
+    pool.reset();
+    REQUIRE(Buffer::alive == 0);
+    stage = 2;
+    thread.join();
+}
+
+TEST_CASE("Concurrent allocations and cross-thread releases") {
+    constexpr size_t kNumThreads = 4;
+    constexpr int kNumIters = 20000;
+    {
+        ObjectPool<Buffer> pool;
+        std::vector<std::vector<IntrusivePtr<Buffer>>> mailboxes(kNumThreads);
+        std::vector<std::mutex> mutexes(kNumThreads);
+        std::atomic<bool> valid = true;
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < kNumThreads; ++i) {
+            threads.emplace_back([&, i] {
+                for (int j = 0; j < kNumIters; ++j) {
+                    auto buffer = pool.Allocate();
+                    if (buffer->owner != -1) {
+                        valid = false;
+                    }
+                    buffer->owner = i;
+                    if (buffer->owner != static_cast<int>(i) || buffer.UseCount() != 1) {
+                        valid = false;
+                    }
+                    buffer->owner = -1;
+                    // Every other buffer is released by the next thread.
+                    if (j % 2) {
+                        size_t next = (i + 1) % kNumThreads;
+                        std::lock_guard lock(mutexes[next]);
+                        mailboxes[next].push_back(std::move(buffer));
+                    }
+                    std::vector<IntrusivePtr<Buffer>> inbox;
+                    {
+                        std::lock_guard lock(mutexes[i]);
+                        inbox.swap(mailboxes[i]);
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        mailboxes.clear();
+
+        REQUIRE(valid);
+        ObjectPoolStats stats = pool.Stats();
+        REQUIRE(stats.allocations == kNumThreads * kNumIters);
+        REQUIRE(stats.releases == stats.allocations);
+        REQUIRE(stats.available == stats.created);
+        REQUIRE(stats.cross_thread_returns > 0);
+    }
+    REQUIRE(Buffer::alive == 0);
+}
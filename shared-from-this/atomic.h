@@ -0,0 +1,283 @@
+#pragma once
+
+#include "shared-from-this/shared.h"
+#include "sw_fwd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+
+// Keeps `owner` alive for a pointer that is not the object of its control block
+// (aliasing constructor, conversion to a base at a non-zero offset), so that the
+// atomic pointers below can recover the pointer from the block alone.
+template <typename T, typename Counter>
+class AliasingControlBlock : public ControlBlock<Counter> {
+public:
+    static constexpr bool kDestroysObject = true;
+
+    AliasingControlBlock(SharedPtr<T, Counter> owner)
+        : ControlBlock<Counter>(&ControlBlock<Counter>::template kManager<AliasingControlBlock>),
+          ptr_(owner.Get()),
+          owner_(std::move(owner)) {
+    }
+
+    void OnZeroShared() {
+        owner_.Reset();
+    }
+    void OnZeroWeak() {
+        delete this;
+    }
+    void* GetObject() {
+        return const_cast<std::remove_const_t<T>*>(ptr_);
+    }
+
+private:
+    T* ptr_;
+    SharedPtr<T, Counter> owner_;
+};
+
+// Control block pointer with a split reference count, the common part of
+// `AtomicSharedPtr` and `AtomicWeakPtr`.
+//
+// The word packs the block pointer (low 48 bits) with a local count (high 16 bits).
+// A published block gets `kReserve` extra references in its own (global) counter.
+// `Load` takes one of them with a single `fetch_add` on the word, without touching the
+// block; once the local count passes `kRefill` the loader gives the taken references
+// back to the global counter. Whoever replaces the block releases the unused part of
+// the reserve. Since a word state (block, local) always stands for the same number of
+// global references, storing the same block again (ABA) does not break the accounting.
+template <typename Counter, bool IsWeak>
+class AtomicBlockPtr {
+public:
+    using Block = ControlBlock<Counter>;
+
+    AtomicBlockPtr() = default;
+    // Takes over the caller's reference to `block`.
+    explicit AtomicBlockPtr(Block* block) : word_(Publish(block)) {
+    }
+    AtomicBlockPtr(const AtomicBlockPtr&) = delete;
+    AtomicBlockPtr& operator=(const AtomicBlockPtr&) = delete;
+    ~AtomicBlockPtr() {
+        Drop(Unpublish(word_.load(std::memory_order_relaxed)));
+    }
+
+    // Returns the current block with one reference for the caller.
+    Block* Load() const {
+        uint64_t word = word_.fetch_add(kLocalOne, std::memory_order_acquire);
+        Block* block = GetBlock(word);
+        if (!block) {
+            return nullptr;
+        }
+        size_t local = GetLocal(word) + 1;
+        assert(local <= kReserve);
+        if (local >= kRefill) {
+            Refill(block, local);
+        }
+        return block;
+    }
+
+    // Takes over the caller's reference to `block` and hands back the one to the previous block.
+    Block* Exchange(Block* block) {
+        return Unpublish(word_.exchange(Publish(block), std::memory_order_acq_rel));
+    }
+
+    // Takes over the caller's reference to `desired`; drops it if the current block is not
+    // `expected`.
+    bool CompareExchange(Block* expected, Block* desired) {
+        uint64_t desired_word = Publish(desired);
+        uint64_t current = word_.load(std::memory_order_relaxed);
+        while (GetBlock(current) == expected) {
+            if (word_.compare_exchange_weak(current, desired_word, std::memory_order_acq_rel,
+                                            std::memory_order_relaxed)) {
+                Drop(Unpublish(current));
+                return true;
+            }
+        }
+        Drop(Unpublish(desired_word));
+        return false;
+    }
+
+private:
+    static_assert(sizeof(void*) == sizeof(uint64_t), "Needs 64-bit pointers");
+
+    static constexpr int kLocalShift = 48;
+    static constexpr uint64_t kLocalOne = uint64_t{1} << kLocalShift;
+    static constexpr uint64_t kBlockMask = kLocalOne - 1;
+    static constexpr size_t kReserve = size_t{1} << 14;
+    static constexpr size_t kRefill = kReserve / 2;
+
+    static Block* GetBlock(uint64_t word) {
+        return reinterpret_cast<Block*>(word & kBlockMask);
+    }
+    static size_t GetLocal(uint64_t word) {
+        return word >> kLocalShift;
+    }
+
+    static void Add(Block* block, size_t count) {
+        if constexpr (IsWeak) {
+            block->AddWeak(count);
+        } else {
+            block->AddShared(count);
+        }
+    }
+    static void Del(Block* block, size_t count) {
+        if constexpr (IsWeak) {
+            block->DelWeak(count);
+        } else {
+            block->DelShared(count);
+        }
+    }
+    static void Drop(Block* block) {
+        if (block) {
+            Del(block, 1);
+        }
+    }
+
+    static uint64_t Publish(Block* block) {
+        auto word = reinterpret_cast<uint64_t>(block);
+        assert((word & ~kBlockMask) == 0);
+        if (block) {
+            Add(block, kReserve);
+        }
+        return word;
+    }
+    static Block* Unpublish(uint64_t word) {
+        Block* block = GetBlock(word);
+        if (block && GetLocal(word) < kReserve) {
+            Del(block, kReserve - GetLocal(word));
+        }
+        return block;
+    }
+
+    // The caller holds a reference, so `block` stays alive while the loop runs.
+    void Refill(Block* block, size_t local) const {
+        Add(block, local);
+        uint64_t current = word_.load(std::memory_order_relaxed);
+        while (GetBlock(current) == block) {
+            size_t taken = std::min(local, GetLocal(current));
+            if (word_.compare_exchange_weak(current, current - taken * kLocalOne,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+                if (taken < local) {
+                    Del(block, local - taken);
+                }
+                return;
+            }
+        }
+        Del(block, local);
+    }
+
+    mutable std::atomic<uint64_t> word_ = 0;
+};
+
+// Lock-free `std::atomic<std::shared_ptr<T>>`: `Load` is one `fetch_add` on the stored word.
+//
+// `UseCount` of a pointer published through it includes references reserved for loads.
+// A `SharedPtr` whose pointer is not the object of its block is published through an extra
+// `AliasingControlBlock`; weak pointers to the loaded copies then track that block.
+template <typename T, typename Counter>
+class AtomicSharedPtr {
+public:
+    AtomicSharedPtr() = default;
+    AtomicSharedPtr(SharedPtr<T, Counter> desired) : block_(Adopt(std::move(desired))) {
+    }
+
+    SharedPtr<T, Counter> Load() const {
+        return Wrap(block_.Load());
+    }
+    void Store(SharedPtr<T, Counter> desired) {
+        Wrap(block_.Exchange(Adopt(std::move(desired))));
+    }
+    SharedPtr<T, Counter> Exchange(SharedPtr<T, Counter> desired) {
+        return Wrap(block_.Exchange(Adopt(std::move(desired))));
+    }
+    // On failure `expected` is reloaded.
+    bool CompareExchange(SharedPtr<T, Counter>& expected, SharedPtr<T, Counter> desired) {
+        if (IsOwnObject(expected) &&
+            block_.CompareExchange(expected.block_, Adopt(std::move(desired)))) {
+            return true;
+        }
+        expected = Load();
+        return false;
+    }
+
+private:
+    using Block = ControlBlock<Counter>;
+
+    static bool IsOwnObject(const SharedPtr<T, Counter>& ptr) {
+        return !ptr.block_ || static_cast<const void*>(ptr.ptr_) == ptr.block_->GetObject();
+    }
+
+    static Block* Adopt(SharedPtr<T, Counter> ptr) {
+        if (!IsOwnObject(ptr)) {
+            return new AliasingControlBlock<T, Counter>(std::move(ptr));
+        }
+        Block* block = ptr.block_;
+        ptr.block_ = nullptr;
+        ptr.ptr_ = nullptr;
+        return block;
+    }
+
+    static SharedPtr<T, Counter> Wrap(Block* block) {
+        SharedPtr<T, Counter> result;
+        if (block) {
+            result.block_ = block;
+            result.ptr_ = static_cast<T*>(block->GetObject());
+        }
+        return result;
+    }
+
+    AtomicBlockPtr<Counter, false> block_;
+};
+
+// Lock-free `std::atomic<std::weak_ptr<T>>`, same scheme as `AtomicSharedPtr` on the weak count.
+// Only weak pointers to the object of their block can be stored.
+template <typename T, typename Counter>
+class AtomicWeakPtr {
+public:
+    AtomicWeakPtr() = default;
+    AtomicWeakPtr(WeakPtr<T, Counter> desired) : block_(Adopt(std::move(desired))) {
+    }
+
+    WeakPtr<T, Counter> Load() const {
+        return Wrap(block_.Load());
+    }
+    void Store(WeakPtr<T, Counter> desired) {
+        Wrap(block_.Exchange(Adopt(std::move(desired))));
+    }
+    WeakPtr<T, Counter> Exchange(WeakPtr<T, Counter> desired) {
+        return Wrap(block_.Exchange(Adopt(std::move(desired))));
+    }
+    // On failure `expected` is reloaded.
+    bool CompareExchange(WeakPtr<T, Counter>& expected, WeakPtr<T, Counter> desired) {
+        if (block_.CompareExchange(expected.block_, Adopt(std::move(desired)))) {
+            return true;
+        }
+        expected = Load();
+        return false;
+    }
+
+private:
+    using Block = ControlBlock<Counter>;
+
+    static Block* Adopt(WeakPtr<T, Counter> ptr) {
+        assert(!ptr.block_ || static_cast<const void*>(ptr.ptr_) == ptr.block_->GetObject());
+        Block* block = ptr.block_;
+        ptr.block_ = nullptr;
+        ptr.ptr_ = nullptr;
+        return block;
+    }
+
+    static WeakPtr<T, Counter> Wrap(Block* block) {
+        WeakPtr<T, Counter> result;
+        if (block) {
+            result.block_ = block;
+            result.ptr_ = static_cast<T*>(block->GetObject());
+        }
+        return result;
+    }
+
+    AtomicBlockPtr<Counter, true> block_;
+};
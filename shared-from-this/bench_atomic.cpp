@@ -0,0 +1,81 @@
+#include "atomic.h"
+
+#include <common/bench.h>
+
+#include <cstdio>
+#include <mutex>
+
+// Readers load the current config while a writer publishes a new one every millisecond:
+// `AtomicSharedPtr` against a `SharedPtr` guarded by a mutex.
+
+namespace {
+
+struct Config {
+    explicit Config(int version) : version(version) {
+    }
+
+    int version;
+    int values[15] = {};
+};
+
+using ConfigPtr = SharedPtr<Config, AtomicCounter>;
+
+constexpr std::chrono::milliseconds kDuration{300};
+
+// Runs `store(version)` every millisecond until the returned thread is stopped.
+template <typename F>
+std::thread StartWriter(const std::atomic<bool>& stop, F store) {
+    return std::thread([&stop, store] {
+        for (int version = 1; !stop.load(std::memory_order_relaxed); ++version) {
+            store(version);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+}
+
+template <typename Read, typename Store>
+double Run(size_t num_threads, Read read, Store store) {
+    std::atomic<bool> stop_writer = false;
+    std::thread writer = StartWriter(stop_writer, store);
+    double result =
+        MeasureThroughput(num_threads, kDuration, [&](size_t, const std::atomic<bool>& stop) {
+            uint64_t ops = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                ConfigPtr config = read();
+                DoNotOptimize(config->version);
+                ++ops;
+            }
+            return ops;
+        });
+    stop_writer = true;
+    writer.join();
+    return result;
+}
+
+}  // namespace
+
+int main() {
+    AtomicSharedPtr<Config> atomic(MakeShared<Config, AtomicCounter>(0));
+
+    std::mutex mutex;
+    ConfigPtr guarded = MakeShared<Config, AtomicCounter>(0);
+
+    std::printf("%8s %18s %18s\n", "threads", "atomic (Mops/s)", "mutex (Mops/s)");
+    for (size_t num_threads : ThreadCounts()) {
+        double atomic_ops = Run(
+            num_threads, [&] { return atomic.Load(); },
+            [&](int version) { atomic.Store(MakeShared<Config, AtomicCounter>(version)); });
+        double mutex_ops = Run(
+            num_threads,
+            [&] {
+                std::lock_guard lock(mutex);
+                return guarded;
+            },
+            [&](int version) {
+                ConfigPtr config = MakeShared<Config, AtomicCounter>(version);
+                std::lock_guard lock(mutex);
+                guarded.Swap(config);
+            });
+        std::printf("%8zu %18.2f %18.2f\n", num_threads, atomic_ops / 1e6, mutex_ops / 1e6);
+    }
+}
@@ -3,9 +3,12 @@
 #include "shared-from-this/weak.h"
 #include "sw_fwd.h"
 
-template <typename T>
+template <typename T, typename Counter>
 class SharedPtr {
 public:
+    // `U` for `SharedPtr<U[]>` and `SharedPtr<U[N]>`.
+    using ElementType = std::remove_extent_t<T>;
+
     SharedPtr() {
         block_ = nullptr;
         ptr_ = nullptr;
@@ -17,8 +20,9 @@ public:
 
     template <typename Y>
     SharedPtr(Y* ptr) {
-        block_ = new PointingControlBlock<Y>(ptr);
+        block_ = new PointingBlock<Y>(ptr);
         ptr_ = ptr;
+        InitWeakThis(ptr, ptr);
     }
 
     SharedPtr(const SharedPtr& other) {
@@ -36,7 +40,7 @@ public:
     }
 
     template <typename Y>
-    SharedPtr(const SharedPtr<Y>& other) {
+    SharedPtr(const SharedPtr<Y, Counter>& other) {
         block_ = other.block_;
         ptr_ = other.ptr_;
         if (block_) {
@@ -44,14 +48,14 @@ public:
         }
     }
     template <typename Y>
-    SharedPtr(SharedPtr<Y>&& other) {
+    SharedPtr(SharedPtr<Y, Counter>&& other) {
         block_ = other.block_;
         ptr_ = other.ptr_;
         other.block_ = nullptr;
         other.ptr_ = nullptr;
     }
     template <typename Y>
-    SharedPtr(const SharedPtr<Y>& other, T* ptr) {
+    SharedPtr(const SharedPtr<Y, Counter>& other, ElementType* ptr) {
         block_ = other.block_;
         ptr_ = ptr;
         if (block_) {
@@ -59,15 +63,12 @@ public:
         }
     }
 
-    explicit SharedPtr(const WeakPtr<T>& other) {
-        if (other.Expired()) {
+    explicit SharedPtr(const WeakPtr<T, Counter>& other) {
+        if (!other.block_ || !other.block_->TryAddShared()) {
             throw BadWeakPtr();
         }
         block_ = other.block_;
         ptr_ = other.ptr_;
-        if (block_) {
-            block_->AddShared();
-        }
     }
 
     SharedPtr& operator=(const SharedPtr& other) {
@@ -95,7 +96,7 @@ public:
     }
 
     template <typename Y>
-    SharedPtr& operator=(const SharedPtr<Y>& other) {
+    SharedPtr& operator=(const SharedPtr<Y, Counter>& other) {
         Reset();
         block_ = other.block_;
         ptr_ = other.ptr_;
@@ -105,7 +106,7 @@ public:
         return *this;
     }
     template <typename Y>
-    SharedPtr& operator=(SharedPtr<Y>&& other) {
+    SharedPtr& operator=(SharedPtr<Y, Counter>&& other) {
         Reset();
         block_ = other.block_;
         ptr_ = other.ptr_;
@@ -131,23 +132,29 @@ public:
         if (block_) {
             block_->DelShared();
         }
-        block_ = new PointingControlBlock<Y>(ptr);
+        block_ = new PointingBlock<Y>(ptr);
         ptr_ = ptr;
+        InitWeakThis(ptr, ptr);
     }
     void Swap(SharedPtr& other) {
         std::swap(block_, other.block_);
         std::swap(ptr_, other.ptr_);
     }
 
-    T* Get() const {
+    ElementType* Get() const {
         return ptr_;
     }
     T& operator*() const {
         return *ptr_;
     }
-    T* operator->() const {
+    ElementType* operator->() const {
         return ptr_;
     }
+    ElementType& operator[](size_t index) const
+        requires std::is_array_v<T>
+    {
+        return ptr_[index];
+    }
     size_t UseCount() const {
         if (!block_) {
             return 0;
@@ -158,62 +165,144 @@ public:
         return ptr_ != nullptr;
     }
 
-    template <typename Y, typename... Args>
-    friend SharedPtr<Y> MakeShared(Args&&... args);
+    template <typename Y, typename C, typename... Args>
+    friend SharedPtr<Y, C> MakeShared(Args&&... args);
+    template <typename Y, typename C, typename... Args>
+    friend SharedPtr<Y, C> MakeSharedForOverwrite(Args... size);
+    template <typename Y, typename C, typename Alloc, typename... Args>
+    friend SharedPtr<Y, C> AllocateShared(const Alloc& alloc, Args&&... args);
 
 private:
-    template <typename Y>
+    template <typename Y, typename C>
     friend class SharedPtr;
-    template <typename Y>
+    template <typename Y, typename C>
     friend class WeakPtr;
+    template <typename Y, typename C>
+    friend class AtomicSharedPtr;
+    template <typename Y, typename C>
+    friend class AtomicWeakPtr;
 
-    T* ptr_;
-    ControlBlock* block_;
+    // Points `EnableSharedFromThis::self_` of a new object at this block, unless another
+    // `SharedPtr` already owns the object. Elements of arrays are left alone.
+    template <typename Y, typename Z>
+    void InitWeakThis(const EnableSharedFromThis<Y, Counter>* base, Z* ptr) {
+        if (!std::is_array_v<T> && base && base->self_.Expired()) {
+            WeakPtr<Y, Counter> self;
+            self.block_ = block_;
+            self.ptr_ = const_cast<std::remove_cv_t<Z>*>(ptr);
+            block_->AddWeak();
+            base->self_ = std::move(self);
+        }
+    }
+    void InitWeakThis(...) {
+    }
+
+    // Block for a pointer from `new Y`, or from `new Y[size]` for `SharedPtr<U[]>`.
+    template <typename Y>
+    using PointingBlock =
+        PointingControlBlock<std::conditional_t<std::is_array_v<T>, Y[], Y>, Counter>;
+
+    ElementType* ptr_;
+    ControlBlock<Counter>* block_;
 };
 
-template <typename T, typename U>
-inline bool operator==(const SharedPtr<T>& left, const SharedPtr<U>& right) {
+template <typename T, typename U, typename Counter>
+inline bool operator==(const SharedPtr<T, Counter>& left, const SharedPtr<U, Counter>& right) {
     return left.Get() == right.Get();
 }
 
-template <typename T, typename... Args>
-SharedPtr<T> MakeShared(Args&&... args) {
-    SharedPtr<T> result;
-    EmplacingControlBlock<T>* emplacing_ptr =
-        new EmplacingControlBlock<T>(std::forward<Args>(args)...);
-    result.block_ = emplacing_ptr;
-    result.ptr_ = emplacing_ptr->Get();
+template <typename T, typename Counter = SimpleCounter, typename... Args>
+SharedPtr<T, Counter> MakeShared(Args&&... args) {
+    SharedPtr<T, Counter> result;
+    // `MakeShared<U[]>(size)` and `MakeShared<U[N]>()`: value-initialized elements.
+    if constexpr (std::is_array_v<T>) {
+        static_assert(sizeof...(Args) == (std::is_bounded_array_v<T> ? 0 : 1),
+                      "Arrays take their size and nothing else");
+        ArrayControlBlock<T, Counter>* block;
+        if constexpr (std::is_bounded_array_v<T>) {
+            block = ArrayControlBlock<T, Counter>::Create(std::extent_v<T>);
+        } else {
+            block = ArrayControlBlock<T, Counter>::Create(args...);
+        }
+        result.block_ = block;
+        result.ptr_ = block->Get();
+    } else {
+        EmplacingControlBlock<T, Counter>* emplacing_ptr =
+            new EmplacingControlBlock<T, Counter>(std::forward<Args>(args)...);
+        result.block_ = emplacing_ptr;
+        result.ptr_ = emplacing_ptr->Get();
+        result.InitWeakThis(result.ptr_, result.ptr_);
+    }
     return result;
 }
 
-template <typename T>
+// `MakeShared` that default-initializes the object or the elements: no zero-filling of buffers
+// about to be overwritten. Pages of large blocks are untouched until first written.
+template <typename T, typename Counter = SimpleCounter, typename... Args>
+SharedPtr<T, Counter> MakeSharedForOverwrite(Args... size) {
+    SharedPtr<T, Counter> result;
+    if constexpr (std::is_array_v<T>) {
+        static_assert(sizeof...(Args) == (std::is_bounded_array_v<T> ? 0 : 1),
+                      "Arrays take their size and nothing else");
+        ArrayControlBlock<T, Counter>* block;
+        if constexpr (std::is_bounded_array_v<T>) {
+            block = ArrayControlBlock<T, Counter>::Create(std::extent_v<T>, ForOverwriteTag{});
+        } else {
+            block = ArrayControlBlock<T, Counter>::Create(size..., ForOverwriteTag{});
+        }
+        result.block_ = block;
+        result.ptr_ = block->Get();
+    } else {
+        static_assert(sizeof...(Args) == 0, "Objects are built without arguments");
+        auto block = new EmplacingControlBlock<T, Counter>(ForOverwriteTag{});
+        result.block_ = block;
+        result.ptr_ = block->Get();
+        result.InitWeakThis(result.ptr_, result.ptr_);
+    }
+    return result;
+}
+
+// `MakeShared` with the memory from `alloc`, which also frees it.
+template <typename T, typename Counter = SimpleCounter, typename Alloc, typename... Args>
+SharedPtr<T, Counter> AllocateShared(const Alloc& alloc, Args&&... args) {
+    SharedPtr<T, Counter> result;
+    auto block =
+        AllocatingControlBlock<T, Alloc, Counter>::Create(alloc, std::forward<Args>(args)...);
+    result.block_ = block;
+    result.ptr_ = block->Get();
+    result.InitWeakThis(result.ptr_, result.ptr_);
+    return result;
+}
+
+template <typename T, typename Counter>
 class EnableSharedFromThis {
 public:
-    SharedPtr<T> SharedFromThis() {
+    SharedPtr<T, Counter> SharedFromThis() {
         if (self_.Expired()) {
             throw BadWeakPtr();
         }
         return self_.Lock();
     }
-    SharedPtr<const T> SharedFromThis() const {
+    SharedPtr<const T, Counter> SharedFromThis() const {
         if (self_.Expired()) {
             throw BadWeakPtr();
         }
         return self_.Lock();
     }
 
-    /*WeakPtr<T> WeakFromThis() noexcept {
+    WeakPtr<T, Counter> WeakFromThis() noexcept {
+        return self_;
+    }
+    WeakPtr<const T, Counter> WeakFromThis() const noexcept {
         return self_;
     }
-    WeakPtr<const T> WeakFromThis() const noexcept {
-        return static_cast<WeakPtr<const T>>(self_);
-    }*/
 
 private:
-    template <typename Y>
+    template <typename Y, typename C>
     friend class SharedPtr;
-    template <typename Y>
+    template <typename Y, typename C>
     friend class WeakPtr;
 
-    WeakPtr<T> self_;
+    // Set by the first `SharedPtr` that owns the object.
+    mutable WeakPtr<T, Counter> self_;
 };
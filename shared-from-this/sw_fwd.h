@@ -1,98 +1,558 @@
 #pragma once
 
+#include "common/block_registry.h"
+#include "common/counters.h"
+#include "common/destruction_queue.h"
+#include "common/destruction_tracer.h"
+#include "common/refcount_profiler.h"
+#include "common/site_profiler.h"
+#include "unique/compressed_pair.h"
+
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <exception>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+template <typename Counter>
+class ControlBlock;
 
+// What a block does when its counts reach zero: one static table per block type instead of a
+// vtable, built by `ControlBlock::kManager` from the block's non-virtual methods.
+template <typename Counter>
+struct BlockManager {
+    // Destroys the object. Does nothing when the object has nothing to destroy.
+    void (*on_zero_shared)(ControlBlock<Counter>*);
+    // Destroys and frees the block.
+    void (*on_zero_weak)(ControlBlock<Counter>*);
+    void* (*get_object)(ControlBlock<Counter>*);
+    // The object is destroyed by `DestructionQueue::Drain`, see `DeferDestruction`.
+    bool defer_destruction;
+    // Pointee type, for `refcount_profiler`. Empty unless SMART_PTR_PROFILE_REFCOUNTS is set.
+    [[no_unique_address]] refcount_profiler::TypeKey refcount_type;
+    // Pointee type, for `block_registry`. Empty unless SMART_PTR_TRACK_BLOCKS is set.
+    [[no_unique_address]] block_registry::TypeInfo registry_type;
+};
+
+// `Counter` selects how the control block counts references:
+// `SimpleCounter` for single-threaded code, `AtomicCounter` to share pointers between threads,
+// `BiasedCounter` (common/biased_counter.h) for pointers mostly copied by the creating thread,
+// `EpochCounter` (common/epoch.h) to keep objects alive for readers inside an `EpochGuard`,
+// `PackedCounter` (common/packed_counter.h) to keep both counts in one 64-bit word.
+//
+// Blocks derive from it and pass `&kManager<Block>` to its constructor. They define
+// `OnZeroShared`, `OnZeroWeak` and `GetObject` without `virtual`, and set `kDestroysObject` to
+// false when `OnZeroShared` has nothing to do.
+template <typename Counter = SimpleCounter>
 class ControlBlock {
 public:
-    ControlBlock() {
-        shared_cnt_ = 1;
-        weak_cnt_ = 1;
-    }
-    virtual ~ControlBlock() = default;
+    ControlBlock(const ControlBlock&) = delete;
+    ControlBlock& operator=(const ControlBlock&) = delete;
 
-    void AddShared() {
-        shared_cnt_++;
-        AddWeak();
+    // All shared owners together hold one weak reference, released after `OnZeroShared`.
+    void AddShared(size_t count = 1) {
+        profile_.Count(refcount_profiler::Op::kAddShared);
+        if constexpr (kPacked) {
+            shared_cnt_.IncShared(count);
+        } else {
+            shared_cnt_.IncRef(count);
+        }
     }
-    void DelShared() {
-        shared_cnt_--;
-        if (shared_cnt_ == 0) {
-            OnZeroShared();
+    // Fails if the object is already destroyed (or is being destroyed by another thread).
+    bool TryAddShared() {
+        bool added;
+        if constexpr (kPacked) {
+            added = shared_cnt_.IncSharedIfNonZero();
+        } else {
+            added = shared_cnt_.IncRefIfNonZero();
+        }
+        if (added) {
+            profile_.Count(refcount_profiler::Op::kAddShared);
+        }
+        return added;
+    }
+    void DelShared(size_t count = 1) {
+        profile_.Count(refcount_profiler::Op::kDelShared);
+        if constexpr (kPacked) {
+            auto counts = shared_cnt_.DecShared(count);
+            if (counts.shared == 0 && !Deferred()) {
+                OnZeroShared();
+                // Without weak pointers nobody else can reach the block.
+                if (counts.weak == 1) {
+                    OnZeroWeak();
+                } else {
+                    DelWeak();
+                }
+            }
+        } else if (shared_cnt_.DecRef(count) == 0) {
+            // `EpochCounter` destroys the object once no reader is inside an `EpochGuard`.
+            if constexpr (requires(Counter& counter) { counter.Retire(nullptr, nullptr); }) {
+                shared_cnt_.Retire(&ControlBlock::SharedReachedZero, this);
+            } else {
+                ReleaseObject();
+            }
         }
-        DelWeak();
     }
 
-    void AddWeak() {
-        weak_cnt_++;
+    void AddWeak(size_t count = 1) {
+        profile_.Count(refcount_profiler::Op::kAddWeak);
+        if constexpr (kPacked) {
+            shared_cnt_.IncWeak(count);
+        } else {
+            weak_cnt_.IncRef(count);
+        }
     }
-    void DelWeak() {
-        weak_cnt_--;
-        if (weak_cnt_ == 0) {
+    void DelWeak(size_t count = 1) {
+        profile_.Count(refcount_profiler::Op::kDelWeak);
+        size_t left;
+        if constexpr (kPacked) {
+            left = shared_cnt_.DecWeak(count);
+        } else {
+            left = weak_cnt_.DecRef(count);
+        }
+        if (left == 0) {
             OnZeroWeak();
         }
     }
 
-    virtual void OnZeroShared() = 0;
-    virtual void OnZeroWeak() = 0;
+    void OnZeroShared() {
+        sample_.Release();
+        manager_->on_zero_shared(this);
+    }
+    void OnZeroWeak() {
+        manager_->on_zero_weak(this);
+    }
+    // The object the block was created for, even after it is destroyed.
+    void* GetObject() {
+        return manager_->get_object(this);
+    }
 
     size_t GetCnt() const {
-        return shared_cnt_;
+        if constexpr (kPacked) {
+            return shared_cnt_.SharedCount();
+        } else {
+            return shared_cnt_.RefCount();
+        }
     }
 
 private:
-    size_t shared_cnt_;
-    size_t weak_cnt_;
+    static constexpr bool kPacked = requires(Counter& counter) { counter.IncWeak(); };
+
+    // Takes the place of `weak_cnt_` when `shared_cnt_` holds both counts.
+    struct NoCounter {
+        explicit NoCounter(size_t) {
+        }
+    };
+
+    // One shared owner, and the weak reference of the shared owners.
+    static Counter InitialCounter() {
+        if constexpr (kPacked) {
+            return Counter(1, 1);
+        } else {
+            return Counter(1);
+        }
+    }
+
+    template <typename Block>
+    static void OnZeroSharedOf(ControlBlock* block) {
+        if constexpr (Block::kDestroysObject) {
+            [[maybe_unused]] destruction_tracer::Trace<BlockPointee<Block>> trace;
+            static_cast<Block*>(block)->OnZeroShared();
+        }
+    }
+    template <typename Block>
+    static void OnZeroWeakOf(ControlBlock* block) {
+        static_cast<Block*>(block)->OnZeroWeak();
+    }
+    template <typename Block>
+    static void* GetObjectOf(ControlBlock* block) {
+        return static_cast<Block*>(block)->GetObject();
+    }
+
+    // The first template argument of every block is the type of the object.
+    template <typename Block>
+    struct BlockPointeeOf;
+    template <template <typename...> typename Block, typename T, typename... Rest>
+    struct BlockPointeeOf<Block<T, Rest...>> {
+        using Type = T;
+    };
+    template <typename Block>
+    using BlockPointee = typename BlockPointeeOf<Block>::Type;
+
+protected:
+    template <typename Block>
+    static constexpr BlockManager<Counter> kManager = {
+        &OnZeroSharedOf<Block>,
+        &OnZeroWeakOf<Block>,
+        &GetObjectOf<Block>,
+        Block::kDestroysObject && DeferDestruction<BlockPointee<Block>>::value,
+        refcount_profiler::TypeKey::Of<BlockPointee<Block>>(),
+        block_registry::TypeInfo::Of<BlockPointee<Block>>(),
+    };
+
+    explicit ControlBlock(const BlockManager<Counter>* manager)
+        : manager_(manager),
+          shared_cnt_(InitialCounter()),
+          weak_cnt_(1),
+          profile_(manager->refcount_type),
+          entry_(manager->registry_type, this, &CountsOf) {
+        // Counters like `BiasedCounter` may drop to zero outside of `DelShared`/`DelWeak`.
+        if constexpr (requires(Counter& counter) { counter.SetOnZero(nullptr, nullptr); }) {
+            shared_cnt_.SetOnZero(&ControlBlock::SharedReachedZero, this);
+            weak_cnt_.SetOnZero(&ControlBlock::WeakReachedZero, this);
+        }
+    }
+    // Blocks destroy themselves in `OnZeroWeak`, never through a base pointer.
+    ~ControlBlock() = default;
+
+    // Lets `site_profiler` sample the creation of the block, once the object is constructed.
+    // `bytes` is the heap memory of block and object.
+    void SampleSite(size_t bytes) {
+        sample_.Take(bytes);
+    }
+
+private:
+    // Destroys the object and drops the weak reference of the shared owners. If that is the
+    // last weak reference, nobody else can reach the block: it is freed without updating the
+    // weak count.
+    void ReleaseObject() {
+        if (Deferred()) {
+            return;
+        }
+        OnZeroShared();
+        if constexpr (requires(const Counter& counter) { counter.IsUnique(); }) {
+            if (weak_cnt_.IsUnique()) {
+                OnZeroWeak();
+                return;
+            }
+        }
+        DelWeak();
+    }
+
+    // Hands the object to `DestructionQueue` if its type asks for it. The weak reference of the
+    // shared owners keeps the block until then.
+    bool Deferred() {
+        if (!manager_->defer_destruction) [[likely]] {
+            return false;
+        }
+        DestructionQueue::Get().Enqueue(&ReleaseDeferred, this, manager_);
+        return true;
+    }
+    static void ReleaseDeferred(void* self) {
+        auto block = static_cast<ControlBlock*>(self);
+        block->OnZeroShared();
+        block->DelWeak();
+    }
+
+    static block_registry::Counts CountsOf(const void* self) {
+        auto block = static_cast<const ControlBlock*>(self);
+        size_t shared = block->GetCnt();
+        size_t weak;
+        if constexpr (kPacked) {
+            weak = block->shared_cnt_.WeakCount();
+        } else {
+            weak = block->weak_cnt_.RefCount();
+        }
+        // Without the weak reference of the shared owners.
+        return {shared, weak - (shared > 0)};
+    }
+
+    static void SharedReachedZero(void* self) {
+        static_cast<ControlBlock*>(self)->ReleaseObject();
+    }
+    static void WeakReachedZero(void* self) {
+        static_cast<ControlBlock*>(self)->OnZeroWeak();
+    }
+
+    const BlockManager<Counter>* manager_;
+    Counter shared_cnt_;
+    [[no_unique_address]] std::conditional_t<kPacked, NoCounter, Counter> weak_cnt_;
+    [[no_unique_address]] refcount_profiler::Counters profile_;
+    [[no_unique_address]] site_profiler::Sample sample_;
+    [[no_unique_address]] block_registry::Entry entry_;
 };
 
-template <typename T>
-class PointingControlBlock : public ControlBlock {
+// `T` is `U[]` for a pointer from `new U[n]`.
+template <typename T, typename Counter = SimpleCounter>
+class PointingControlBlock : public ControlBlock<Counter> {
 public:
-    PointingControlBlock(T* ptr) : ControlBlock(), ptr_(ptr) {
+    static constexpr bool kDestroysObject = true;
+
+    PointingControlBlock(std::remove_extent_t<T>* ptr)
+        : ControlBlock<Counter>(&ControlBlock<Counter>::template kManager<PointingControlBlock>),
+          ptr_(ptr) {
+        // The length of a `new U[n]` array is unknown, only its first element is counted.
+        this->SampleSite(sizeof(PointingControlBlock) + sizeof(std::remove_extent_t<T>));
     }
-    virtual ~PointingControlBlock() = default;
-    void OnZeroShared() override {
-        if (ptr_) {
+
+    void OnZeroShared() {
+        if constexpr (std::is_array_v<T>) {
+            delete[] ptr_;
+        } else if (ptr_) {
             delete ptr_;
         }
     }
-    void OnZeroWeak() override {
+    void OnZeroWeak() {
         ptr_ = nullptr;
         delete this;
     }
+    void* GetObject() {
+        return ptr_;
+    }
 
 private:
-    T* ptr_;
+    std::remove_extent_t<T>* ptr_;
 };
 
+// Specialize as `std::true_type` for objects whose fields are read by many threads while other
+// threads copy and drop pointers to them: `MakeShared` then puts the object on its own cache
+// lines, away from the counters the copies write to. The block grows by up to a cache line.
 template <typename T>
-class EmplacingControlBlock : public ControlBlock {
+struct IsolateCounters : std::false_type {};
+
+// Selects default-initialization, as in `MakeSharedForOverwrite`.
+struct ForOverwriteTag {};
+
+template <typename T, typename Counter = SimpleCounter>
+class EmplacingControlBlock : public ControlBlock<Counter> {
 public:
+    static constexpr bool kDestroysObject = !std::is_trivially_destructible_v<T>;
+
     template <typename... Args>
-    EmplacingControlBlock(Args&&... args) : ControlBlock() {
+    EmplacingControlBlock(Args&&... args)
+        : ControlBlock<Counter>(&ControlBlock<Counter>::template kManager<EmplacingControlBlock>) {
         new (&buffer_) T(std::forward<Args>(args)...);
+        this->SampleSite(sizeof(EmplacingControlBlock));
+    }
+    explicit EmplacingControlBlock(ForOverwriteTag)
+        : ControlBlock<Counter>(&ControlBlock<Counter>::template kManager<EmplacingControlBlock>) {
+        new (&buffer_) T;
+        this->SampleSite(sizeof(EmplacingControlBlock));
     }
-    virtual ~EmplacingControlBlock() = default;
 
-    void OnZeroShared() override {
+    void OnZeroShared() {
         Get()->~T();
     }
-    void OnZeroWeak() override {
+    void OnZeroWeak() {
         delete this;
     }
+    void* GetObject() {
+        return Get();
+    }
 
     T* Get() {
         return reinterpret_cast<T*>(&buffer_);
     }
 
 private:
-    alignas(T) std::byte buffer_[sizeof(T)];
+    // Over-aligned blocks come from the aligned `operator new`.
+    static constexpr size_t kAlign =
+        IsolateCounters<T>::value ? std::max<size_t>(alignof(T), 64) : alignof(T);
+
+    alignas(kAlign) std::byte buffer_[sizeof(T)];
 };
 
-class BadWeakPtr : public std::exception {};
+// Block and elements of `MakeShared<U[]>(size)` or `MakeShared<U[N]>()` in one allocation: the
+// elements follow the block. They are value-initialized (default-initialized with
+// `ForOverwriteTag`) in order and destroyed in reverse.
+template <typename T, typename Counter = SimpleCounter>
+class ArrayControlBlock : public ControlBlock<Counter> {
+public:
+    using Element = std::remove_extent_t<T>;
+
+    static constexpr bool kDestroysObject = !std::is_trivially_destructible_v<Element>;
 
+    static ArrayControlBlock* Create(size_t size) {
+        return Build<false>(size);
+    }
+    static ArrayControlBlock* Create(size_t size, ForOverwriteTag) {
+        return Build<true>(size);
+    }
+
+    void OnZeroShared() {
+        Destroy(GetSize());
+    }
+    void OnZeroWeak() {
+        size_t size = GetSize();
+        this->~ArrayControlBlock();
+        Deallocate(this, size);
+    }
+    void* GetObject() {
+        return Get();
+    }
+
+    Element* Get() {
+        return reinterpret_cast<Element*>(reinterpret_cast<std::byte*>(this) + ElementsOffset());
+    }
+
+private:
+    static constexpr size_t kAlign = std::max(alignof(ControlBlock<Counter>), alignof(Element));
+
+    static constexpr size_t ElementsOffset() {
+        return (sizeof(ArrayControlBlock) + alignof(Element) - 1) / alignof(Element) *
+               alignof(Element);
+    }
+    static size_t AllocationSize(size_t size) {
+        return ElementsOffset() + size * sizeof(Element);
+    }
+    static void* Allocate(size_t size) {
+        // `AllocationSize` would wrap around.
+        if (size > (SIZE_MAX - ElementsOffset()) / sizeof(Element)) {
+            throw std::bad_array_new_length();
+        }
+        if constexpr (kAlign > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            return ::operator new(AllocationSize(size), std::align_val_t{kAlign});
+        } else {
+            return ::operator new(AllocationSize(size));
+        }
+    }
+    static void Deallocate(void* memory, size_t size) {
+        if constexpr (kAlign > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            ::operator delete(memory, AllocationSize(size), std::align_val_t{kAlign});
+        } else {
+            ::operator delete(memory, AllocationSize(size));
+        }
+    }
+
+    explicit ArrayControlBlock(size_t size)
+        : ControlBlock<Counter>(&ControlBlock<Counter>::template kManager<ArrayControlBlock>),
+          size_(size) {
+    }
+
+    template <bool ForOverwrite>
+    static ArrayControlBlock* Build(size_t size) {
+        void* memory = Allocate(size);
+        auto block = ::new (memory) ArrayControlBlock(size);
+        size_t constructed = 0;
+        try {
+            for (; constructed < size; ++constructed) {
+                void* element = block->Get() + constructed;
+                if constexpr (ForOverwrite) {
+                    ::new (element) Element;
+                } else {
+                    ::new (element) Element();
+                }
+            }
+        } catch (...) {
+            block->Destroy(constructed);
+            block->~ArrayControlBlock();
+            Deallocate(memory, size);
+            throw;
+        }
+        block->SampleSite(AllocationSize(size));
+        return block;
+    }
+
+    size_t GetSize() const {
+        if constexpr (std::is_bounded_array_v<T>) {
+            return std::extent_v<T>;
+        } else {
+            return size_;
+        }
+    }
+
+    void Destroy(size_t count) {
+        Element* elements = Get();
+        while (count > 0) {
+            elements[--count].~Element();
+        }
+    }
+
+    // The length of `U[N]` is part of the type.
+    struct NoSize {
+        explicit NoSize(size_t) {
+        }
+    };
+
+    [[no_unique_address]] std::conditional_t<std::is_unbounded_array_v<T>, size_t, NoSize> size_;
+};
+
+// Uninitialized room for a `T`, left alone by `CompressedPair`.
 template <typename T>
+struct ObjectStorage {
+    ObjectStorage() {
+    }
+
+    alignas(T) std::byte bytes[sizeof(T)];
+};
+
+// Block and object in one allocation from `Alloc`. The block keeps the allocator to destroy the
+// object and free itself; a stateless allocator takes no space.
+template <typename T, typename Alloc, typename Counter = SimpleCounter>
+class AllocatingControlBlock : public ControlBlock<Counter> {
+public:
+    using ObjectAlloc =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<std::remove_cv_t<T>>;
+    using BlockAlloc =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<AllocatingControlBlock>;
+
+    static constexpr bool kDestroysObject =
+        !std::is_trivially_destructible_v<T> ||
+        requires(ObjectAlloc& alloc, std::remove_cv_t<T>* ptr) { alloc.destroy(ptr); };
+
+    template <typename... Args>
+    static AllocatingControlBlock* Create(const Alloc& alloc, Args&&... args) {
+        BlockAlloc block_alloc(alloc);
+        AllocatingControlBlock* block =
+            std::allocator_traits<BlockAlloc>::allocate(block_alloc, 1);
+        try {
+            ::new (static_cast<void*>(block))
+                AllocatingControlBlock(block_alloc, std::forward<Args>(args)...);
+        } catch (...) {
+            std::allocator_traits<BlockAlloc>::deallocate(block_alloc, block, 1);
+            throw;
+        }
+        return block;
+    }
+
+    void OnZeroShared() {
+        std::allocator_traits<ObjectAlloc>::destroy(GetAllocator(), Get());
+    }
+    void OnZeroWeak() {
+        BlockAlloc block_alloc(GetAllocator());
+        this->~AllocatingControlBlock();
+        std::allocator_traits<BlockAlloc>::deallocate(block_alloc, this, 1);
+    }
+    void* GetObject() {
+        return Get();
+    }
+
+    T* Get() {
+        return reinterpret_cast<T*>(&storage_.GetSecond().bytes);
+    }
+
+private:
+    template <typename... Args>
+    AllocatingControlBlock(const BlockAlloc& alloc, Args&&... args)
+        : ControlBlock<Counter>(
+              &ControlBlock<Counter>::template kManager<AllocatingControlBlock>),
+          storage_(ObjectAlloc(alloc)) {
+        std::allocator_traits<ObjectAlloc>::construct(GetAllocator(), Get(),
+                                                      std::forward<Args>(args)...);
+    }
+
+    ObjectAlloc& GetAllocator() {
+        return storage_.GetFirst();
+    }
+
+    CompressedPair<ObjectAlloc, ObjectStorage<T>> storage_;
+};
+
+class BadWeakPtr : public std::exception {};
+
+template <typename T, typename Counter = SimpleCounter>
 class SharedPtr;
 
-template <typename T>
+template <typename T, typename Counter = SimpleCounter>
 class WeakPtr;
+
+template <typename T, typename Counter = AtomicCounter>
+class AtomicSharedPtr;
+
+template <typename T, typename Counter = AtomicCounter>
+class AtomicWeakPtr;
+
+template <typename T, typename Counter = SimpleCounter>
+class EnableSharedFromThis;
@@ -70,7 +70,7 @@ TEST_CASE("SharedFromThis") {
         weak.Reset();
     }
 }
-/*
+
 TEST_CASE("WeakFromThis") {
     T* ptr = new T;
     const T* cptr = ptr;
@@ -89,4 +89,3 @@ TEST_CASE("WeakFromThis") {
     REQUIRE(!weak.Expired());
     REQUIRE(weak.Lock().Get() == ptr);
 }
-*/
\ No newline at end of file
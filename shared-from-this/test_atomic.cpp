@@ -0,0 +1,184 @@
+#include "atomic.h"
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Config {
+    explicit Config(int version) : version(version) {
+        ++alive;
+    }
+    ~Config() {
+        version = -1;
+        --alive;
+    }
+
+    int version;
+
+    inline static std::atomic<int> alive = 0;
+};
+
+struct Left {
+    int left = 1;
+};
+
+struct Right {
+    int right = 2;
+};
+
+struct Both : Left, Right {};
+
+}  // namespace
+
+TEST_CASE("AtomicSharedPtr basics") {
+    {
+        AtomicSharedPtr<Config> empty;
+        REQUIRE(!empty.Load());
+
+        auto first = MakeShared<Config, AtomicCounter>(1);
+        AtomicSharedPtr<Config> ptr(first);
+        REQUIRE(ptr.Load() == first);
+        REQUIRE(ptr.Load()->version == 1);
+
+        ptr.Store(MakeShared<Config, AtomicCounter>(2));
+        REQUIRE(ptr.Load()->version == 2);
+        REQUIRE(first.UseCount() == 1);
+
+        auto second = ptr.Exchange(first);
+        REQUIRE(second->version == 2);
+        REQUIRE(ptr.Load() == first);
+
+        ptr.Store(nullptr);
+        REQUIRE(!ptr.Load());
+        REQUIRE(first.UseCount() == 1);
+        REQUIRE(Config::alive == 2);
+    }
+    REQUIRE(Config::alive == 0);
+}
+
+TEST_CASE("AtomicSharedPtr CompareExchange") {
+    {
+        auto first = MakeShared<Config, AtomicCounter>(1);
+        auto second = MakeShared<Config, AtomicCounter>(2);
+        AtomicSharedPtr<Config> ptr(first);
+
+        auto expected = second;
+        REQUIRE(!ptr.CompareExchange(expected, MakeShared<Config, AtomicCounter>(3)));
+        REQUIRE(expected == first);
+        REQUIRE(Config::alive == 2);
+
+        REQUIRE(ptr.CompareExchange(expected, second));
+        REQUIRE(ptr.Load() == second);
+        expected.Reset();
+        REQUIRE(first.UseCount() == 1);
+    }
+    REQUIRE(Config::alive == 0);
+}
+
+TEST_CASE("AtomicSharedPtr keeps aliased pointers") {
+    auto both = MakeShared<Both, AtomicCounter>();
+    SharedPtr<Right, AtomicCounter> right(both);
+    SharedPtr<int, AtomicCounter> alias(both, &both->left);
+
+    AtomicSharedPtr<Right> atomic_right(right);
+    AtomicSharedPtr<int> atomic_alias(alias);
+    REQUIRE(atomic_right.Load() == right);
+    REQUIRE(atomic_right.Load()->right == 2);
+    REQUIRE(atomic_alias.Load().Get() == &both->left);
+
+    auto expected = right;
+    REQUIRE(!atomic_right.CompareExchange(expected, nullptr));
+    REQUIRE(expected == right);
+    REQUIRE(atomic_right.CompareExchange(expected, nullptr));
+    REQUIRE(!atomic_right.Load());
+    expected.Reset();
+
+    WeakPtr<Both, AtomicCounter> weak(both);
+    both.Reset();
+    right.Reset();
+    alias.Reset();
+    REQUIRE(!weak.Expired());
+    atomic_alias.Store(nullptr);
+    REQUIRE(weak.Expired());
+}
+
+TEST_CASE("AtomicSharedPtr many loads") {
+    {
+        AtomicSharedPtr<Config> ptr(MakeShared<Config, AtomicCounter>(1));
+        std::vector<SharedPtr<Config, AtomicCounter>> loaded;
+        for (int i = 0; i < 100000; ++i) {
+            loaded.push_back(ptr.Load());
+            if (loaded.size() > 1000) {
+                loaded.clear();
+            }
+        }
+        REQUIRE(loaded.back()->version == 1);
+        ptr.Store(nullptr);
+        REQUIRE(Config::alive == 1);
+    }
+    REQUIRE(Config::alive == 0);
+}
+
+TEST_CASE("AtomicWeakPtr basics") {
+    auto first = MakeShared<Config, AtomicCounter>(1);
+    AtomicWeakPtr<Config> weak(first);
+    REQUIRE(weak.Load().Lock() == first);
+
+    auto second = MakeShared<Config, AtomicCounter>(2);
+    auto old = weak.Exchange(second);
+    REQUIRE(old.Lock() == first);
+
+    auto expected = old;
+    REQUIRE(!weak.CompareExchange(expected, first));
+    REQUIRE(expected.Lock() == second);
+    REQUIRE(weak.CompareExchange(expected, first));
+
+    first.Reset();
+    REQUIRE(weak.Load().Expired());
+    REQUIRE(Config::alive == 1);
+}
+
+TEST_CASE("AtomicSharedPtr with concurrent readers") {
+    {
+        AtomicSharedPtr<Config> current(MakeShared<Config, AtomicCounter>(0));
+        AtomicWeakPtr<Config> latest(current.Load());
+        std::atomic<bool> done = false;
+        std::atomic<int> bad_reads = 0;
+
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 4; ++i) {
+            readers.emplace_back([&] {
+                int last = 0;
+                while (!done) {
+                    auto config = current.Load();
+                    if (config->version < last) {
+                        ++bad_reads;
+                    }
+                    last = config->version;
+                    if (auto locked = latest.Load().Lock(); locked && locked->version < 0) {
+                        ++bad_reads;
+                    }
+                }
+            });
+        }
+        for (int version = 1; version <= 2000; ++version) {
+            auto config = MakeShared<Config, AtomicCounter>(version);
+            latest.Store(config);
+            current.Store(std::move(config));
+        }
+        done = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        REQUIRE(bad_reads == 0);
+        REQUIRE(Config::alive == 1);
+    }
+    REQUIRE(Config::alive == 0);
+}
@@ -2,7 +2,7 @@
 
 #include "sw_fwd.h"
 
-template <typename T>
+template <typename T, typename Counter>
 class WeakPtr {
 public:
     WeakPtr() {
@@ -24,7 +24,16 @@ public:
         other.ptr_ = nullptr;
     }
 
-    WeakPtr(const SharedPtr<T>& other) {
+    template <typename Y>
+    WeakPtr(const WeakPtr<Y, Counter>& other) {
+        block_ = other.block_;
+        ptr_ = other.ptr_;
+        if (block_) {
+            block_->AddWeak();
+        }
+    }
+
+    WeakPtr(const SharedPtr<T, Counter>& other) {
         block_ = other.block_;
         ptr_ = other.ptr_;
         if (block_) {
@@ -81,27 +90,25 @@ public:
     bool Expired() const {
         return UseCount() == 0;
     }
-    SharedPtr<T> Lock() const {
-        SharedPtr<T> result;
-        if (Expired()) {
-            result.block_ = nullptr;
-            result.ptr_ = nullptr;
-            return result;
-        }
-        result.block_ = block_;
-        result.ptr_ = ptr_;
-        if (block_) {
-            block_->AddShared();
+    SharedPtr<T, Counter> Lock() const {
+        SharedPtr<T, Counter> result;
+        if (block_ && block_->TryAddShared()) {
+            result.block_ = block_;
+            result.ptr_ = ptr_;
         }
         return result;
     }
 
 private:
-    template <typename Y>
+    template <typename Y, typename C>
     friend class SharedPtr;
-    template <typename Y>
+    template <typename Y, typename C>
     friend class WeakPtr;
+    template <typename Y, typename C>
+    friend class AtomicSharedPtr;
+    template <typename Y, typename C>
+    friend class AtomicWeakPtr;
 
-    T* ptr_;
-    ControlBlock* block_;
+    std::remove_extent_t<T>* ptr_;
+    ControlBlock<Counter>* block_;
 };
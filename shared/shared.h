@@ -2,7 +2,55 @@
 
 #include "sw_fwd.h"
 
+#include "common/slab.h"
+#include "unique/compressed_pair.h"
+
 #include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+// Control blocks for `T` come from `SlabAllocator` (common/slab.h) instead of the heap.
+// Specialize it for a type, or define SHARED_PTR_SLAB_ALLOCATOR to enable it for all types.
+template <typename T>
+struct UseSlabAllocator
+#ifdef SHARED_PTR_SLAB_ALLOCATOR
+    : std::true_type
+#else
+    : std::false_type
+#endif
+{
+};
+
+// Small blocks share size classes of 16 bytes, larger ones get a free list of their own.
+template <typename Block>
+inline constexpr size_t kBlockSizeClass =
+    sizeof(Block) <= 256 ? (sizeof(Block) + 15) / 16 * 16 : sizeof(Block);
+
+template <typename Block>
+using BlockSlab = SlabAllocator<kBlockSizeClass<Block>, alignof(Block)>;
+
+template <typename T, typename Block>
+void* AllocateBlock(size_t size) {
+    if constexpr (UseSlabAllocator<T>::value) {
+        return BlockSlab<Block>::Allocate();
+    } else if constexpr (alignof(Block) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        return ::operator new(size, std::align_val_t{alignof(Block)});
+    } else {
+        return ::operator new(size);
+    }
+}
+
+template <typename T, typename Block>
+void DeallocateBlock(void* ptr, size_t size) {
+    if constexpr (UseSlabAllocator<T>::value) {
+        BlockSlab<Block>::Deallocate(ptr);
+    } else if constexpr (alignof(Block) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        ::operator delete(ptr, size, std::align_val_t{alignof(Block)});
+    } else {
+        ::operator delete(ptr, size);
+    }
+}
 
 class ControlBlock {
 public:
@@ -45,6 +93,13 @@ public:
         delete this;
     }
 
+    static void* operator new(size_t size) {
+        return AllocateBlock<T, PointingControlBlock>(size);
+    }
+    static void operator delete(void* ptr, size_t size) {
+        DeallocateBlock<T, PointingControlBlock>(ptr, size);
+    }
+
 private:
     T* ptr_;
 };
@@ -67,10 +122,77 @@ public:
         return reinterpret_cast<T*>(&buffer_);
     }
 
+    static void* operator new(size_t size) {
+        return AllocateBlock<T, EmplacingControlBlock>(size);
+    }
+    static void operator delete(void* ptr, size_t size) {
+        DeallocateBlock<T, EmplacingControlBlock>(ptr, size);
+    }
+
 private:
     alignas(T) std::byte buffer_[sizeof(T)];
 };
 
+// Uninitialized room for a `T`, left alone by `CompressedPair`.
+template <typename T>
+struct ObjectStorage {
+    ObjectStorage() {
+    }
+
+    alignas(T) std::byte bytes[sizeof(T)];
+};
+
+// Block and object in one allocation from `Alloc`. The block keeps the allocator to destroy the
+// object and free itself; a stateless allocator takes no space.
+template <typename T, typename Alloc>
+class AllocatingControlBlock : public ControlBlock {
+public:
+    using ObjectAlloc =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<std::remove_cv_t<T>>;
+    using BlockAlloc =
+        typename std::allocator_traits<Alloc>::template rebind_alloc<AllocatingControlBlock>;
+
+    template <typename... Args>
+    static AllocatingControlBlock* Create(const Alloc& alloc, Args&&... args) {
+        BlockAlloc block_alloc(alloc);
+        AllocatingControlBlock* block =
+            std::allocator_traits<BlockAlloc>::allocate(block_alloc, 1);
+        try {
+            ::new (static_cast<void*>(block))
+                AllocatingControlBlock(block_alloc, std::forward<Args>(args)...);
+        } catch (...) {
+            std::allocator_traits<BlockAlloc>::deallocate(block_alloc, block, 1);
+            throw;
+        }
+        return block;
+    }
+
+    void OnZero() override {
+        std::allocator_traits<ObjectAlloc>::destroy(GetAllocator(), Get());
+        BlockAlloc block_alloc(GetAllocator());
+        this->~AllocatingControlBlock();
+        std::allocator_traits<BlockAlloc>::deallocate(block_alloc, this, 1);
+    }
+
+    T* Get() {
+        return reinterpret_cast<T*>(&storage_.GetSecond().bytes);
+    }
+
+private:
+    template <typename... Args>
+    AllocatingControlBlock(const BlockAlloc& alloc, Args&&... args)
+        : ControlBlock(), storage_(ObjectAlloc(alloc)) {
+        std::allocator_traits<ObjectAlloc>::construct(GetAllocator(), Get(),
+                                                      std::forward<Args>(args)...);
+    }
+
+    ObjectAlloc& GetAllocator() {
+        return storage_.GetFirst();
+    }
+
+    CompressedPair<ObjectAlloc, ObjectStorage<T>> storage_;
+};
+
 template <typename T>
 class SharedPtr {
 public:
@@ -221,6 +343,8 @@ public:
 
     template <typename Y, typename... Args>
     friend SharedPtr<Y> MakeShared(Args&&... args);
+    template <typename Y, typename Alloc, typename... Args>
+    friend SharedPtr<Y> AllocateShared(const Alloc& alloc, Args&&... args);
 
     template <typename Y>
     friend class SharedPtr;
@@ -245,6 +369,16 @@ SharedPtr<T> MakeShared(Args&&... args) {
     return result;
 }
 
+// `MakeShared` with the memory from `alloc`, which also frees it.
+template <typename T, typename Alloc, typename... Args>
+SharedPtr<T> AllocateShared(const Alloc& alloc, Args&&... args) {
+    SharedPtr<T> result;
+    auto block = AllocatingControlBlock<T, Alloc>::Create(alloc, std::forward<Args>(args)...);
+    result.block_ = block;
+    result.ptr_ = block->Get();
+    return result;
+}
+
 // Look for usage examples in tests
 template <typename T>
 class EnableSharedFromThis {
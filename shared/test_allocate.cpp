@@ -0,0 +1,103 @@
+#include "shared.h"
+
+#include <catch.hpp>
+
+#include "allocations_checker.h"
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Bump allocator over a fixed buffer, counting what it hands out and gets back.
+struct Arena {
+    alignas(std::max_align_t) std::byte buffer[1024];
+    size_t used = 0;
+    size_t allocations = 0;
+    size_t deallocations = 0;
+};
+
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(Arena* arena) : arena_(arena) {
+    }
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena_) {
+    }
+
+    T* allocate(size_t n) {
+        size_t offset = (arena_->used + alignof(T) - 1) / alignof(T) * alignof(T);
+        arena_->used = offset + n * sizeof(T);
+        REQUIRE(arena_->used <= sizeof(arena_->buffer));
+        ++arena_->allocations;
+        return reinterpret_cast<T*>(arena_->buffer + offset);
+    }
+    void deallocate(T*, size_t) {
+        ++arena_->deallocations;
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return arena_ == other.arena_;
+    }
+
+private:
+    template <typename U>
+    friend class ArenaAllocator;
+
+    Arena* arena_;
+};
+
+struct Throwing {
+    Throwing() {
+        throw std::runtime_error("Throwing");
+    }
+};
+
+}  // namespace
+
+TEST_CASE("AllocateShared takes the memory from the allocator") {
+    Arena arena;
+    {
+        ArenaAllocator<int> alloc(&arena);
+        SharedPtr<std::string> ptr;
+        EXPECT_ZERO_ALLOCATIONS(ptr = AllocateShared<std::string>(alloc, "abc"));
+        REQUIRE(*ptr == "abc");
+        REQUIRE(reinterpret_cast<std::byte*>(ptr.Get()) > arena.buffer);
+        REQUIRE(reinterpret_cast<std::byte*>(ptr.Get()) < arena.buffer + arena.used);
+
+        auto copy = ptr;
+        REQUIRE(ptr.UseCount() == 2);
+        ptr.Reset();
+        REQUIRE(*copy == "abc");
+        REQUIRE(arena.deallocations == 0);
+    }
+    REQUIRE(arena.allocations == 1);
+    REQUIRE(arena.deallocations == 1);
+}
+
+TEST_CASE("Stateless allocators take no space") {
+    REQUIRE(sizeof(AllocatingControlBlock<int, std::allocator<int>>) ==
+            sizeof(EmplacingControlBlock<int>));
+    REQUIRE(sizeof(AllocatingControlBlock<int, ArenaAllocator<int>>) >
+            sizeof(EmplacingControlBlock<int>));
+
+    SharedPtr<int> ptr;
+    EXPECT_ONE_ALLOCATION(ptr = AllocateShared<int>(std::allocator<char>(), 42));
+    REQUIRE(*ptr == 42);
+}
+
+TEST_CASE("AllocateShared frees the memory if the constructor throws") {
+    Arena arena;
+    ArenaAllocator<Throwing> alloc(&arena);
+    REQUIRE_THROWS_AS(AllocateShared<Throwing>(alloc), std::runtime_error);
+    REQUIRE(arena.allocations == 1);
+    REQUIRE(arena.deallocations == 1);
+}
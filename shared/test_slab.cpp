@@ -0,0 +1,146 @@
+#include "shared.h"
+
+#include <catch.hpp>
+
+#include "allocations_checker.h"
+
+#include <barrier>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Point {
+    int x = 0;
+    int y = 0;
+};
+
+struct Large {
+    char data[1000] = {};
+};
+
+struct alignas(64) Aligned {
+    int value = 0;
+};
+
+// Holds a heap buffer of its own.
+struct Text {
+    Text() = default;
+    Text(size_t size, char c) : value(size, c) {
+    }
+
+    std::string value;
+};
+
+}  // namespace
+
+template <>
+struct UseSlabAllocator<Point> : std::true_type {};
+
+template <>
+struct UseSlabAllocator<Large> : std::true_type {};
+
+template <>
+struct UseSlabAllocator<Aligned> : std::true_type {};
+
+template <>
+struct UseSlabAllocator<Text> : std::true_type {};
+
+TEST_CASE("Slab: blocks are recycled") {
+    auto first = MakeShared<Point>();
+    Point* address = first.Get();
+    first.Reset();
+    REQUIRE(MakeShared<Point>().Get() == address);
+}
+
+TEST_CASE("Slab: no heap calls for control blocks") {
+    constexpr size_t kCount = 100;
+    SharedPtr<Point> points[kCount];
+    SharedPtr<Large> larges[kCount];
+
+    // The first blocks carve slabs.
+    for (size_t i = 0; i < kCount; ++i) {
+        points[i] = MakeShared<Point>();
+        larges[i] = MakeShared<Large>();
+    }
+    for (size_t i = 0; i < kCount; ++i) {
+        points[i] = SharedPtr<Point>(new Point);
+    }
+    for (size_t i = 0; i < kCount; ++i) {
+        points[i].Reset();
+        larges[i].Reset();
+    }
+
+    EXPECT_ZERO_ALLOCATIONS(for (size_t i = 0; i < kCount; ++i) {
+        points[i] = MakeShared<Point>();
+        larges[i] = MakeShared<Large>();
+    });
+    for (size_t i = 0; i < kCount; ++i) {
+        points[i].Reset();
+    }
+    // Only the object itself.
+    EXPECT_ONE_ALLOCATION(points[0] = SharedPtr<Point>(new Point));
+
+    // Only the string buffer, once the size class has a slab.
+    MakeShared<Text>();
+    EXPECT_ONE_ALLOCATION(REQUIRE(MakeShared<Text>(100, 'a')->value.size() == 100));
+}
+
+TEST_CASE("Slab: over-aligned types") {
+    SharedPtr<Aligned> ptrs[10];
+    for (auto& ptr : ptrs) {
+        ptr = MakeShared<Aligned>();
+        REQUIRE(reinterpret_cast<uintptr_t>(ptr.Get()) % alignof(Aligned) == 0);
+    }
+}
+
+TEST_CASE("Slab: blocks freed by another thread") {
+    SharedPtr<Point> ptrs[200];
+    for (auto& ptr : ptrs) {
+        ptr = MakeShared<Point>(1, 2);
+    }
+    std::thread([&ptrs] {
+        for (auto& ptr : ptrs) {
+            ptr.Reset();
+        }
+    }).join();
+    // The exited thread left its chunks to the others.
+    EXPECT_ZERO_ALLOCATIONS(for (auto& ptr : ptrs) { ptr = MakeShared<Point>(3, 4); });
+    REQUIRE(ptrs[199]->y == 4);
+}
+
+TEST_CASE("Slab: chunks freed by another thread return to the allocating one") {
+    using Slab = SlabAllocator<72, 8>;
+    constexpr size_t kChunks = 1000;
+    constexpr int kRounds = 100;
+    size_t slabs_before = Slab::NumSlabs();
+
+    // This thread allocates, the other one frees, in turns.
+    std::vector<void*> chunks;
+    std::barrier turn(2);
+    std::thread consumer([&] {
+        for (int round = 0; round < kRounds; ++round) {
+            turn.arrive_and_wait();
+            for (void* chunk : chunks) {
+                Slab::Deallocate(chunk);
+            }
+            turn.arrive_and_wait();
+        }
+    });
+    for (int round = 0; round < kRounds; ++round) {
+        chunks.clear();
+        for (size_t i = 0; i < kChunks; ++i) {
+            chunks.push_back(Slab::Allocate());
+        }
+        turn.arrive_and_wait();
+        turn.arrive_and_wait();
+    }
+    consumer.join();
+
+    // The chunks of one round, plus what each thread may keep for itself.
+    REQUIRE(Slab::NumSlabs() - slabs_before <= kChunks / 64 + 5);
+}
@@ -91,6 +91,10 @@ class CompressedPair : public First<F>, public Second<S> {
 public:
     CompressedPair() : First<F>(), Second<S>() {
     }
+    explicit CompressedPair(const F& first) : First<F>(first), Second<S>() {
+    }
+    explicit CompressedPair(F&& first) : First<F>(std::move(first)), Second<S>() {
+    }
     CompressedPair(const F& first, const S& second) : First<F>(first), Second<S>(second) {
     }
     CompressedPair(F&& first, const S& second) : First<F>(std::move(first)), Second<S>(second) {
@@ -502,4 +502,17 @@ TEST_CASE("Upcasts") {
         UniquePtr<MyInt, Deleter<MyInt>> s2(new MyInt);
         s2 = std::move(s);
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("MakeUniqueForOverwrite") {
+    auto number = MakeUniqueForOverwrite<MyInt>();
+    REQUIRE(MyInt::AliveCount() == 1);
+    number.Reset();
+    REQUIRE(MyInt::AliveCount() == 0);
+
+    auto buffer = MakeUniqueForOverwrite<char[]>(1 << 20);
+    buffer[0] = 'a';
+    buffer[(1 << 20) - 1] = 'z';
+    REQUIRE(buffer[0] == 'a');
+    REQUIRE(buffer[(1 << 20) - 1] == 'z');
+}
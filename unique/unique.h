@@ -187,3 +187,17 @@ public:
 private:
     CompressedPair<T*, Deleter> data_;
 };
+
+// `new T` and `new T[size]` without value-initialization, for buffers about to be overwritten.
+// Pages of large buffers are untouched until first written.
+template <typename T>
+    requires(!std::is_array_v<T>)
+UniquePtr<T> MakeUniqueForOverwrite() {
+    return UniquePtr<T>(new T);
+}
+
+template <typename T>
+    requires std::is_unbounded_array_v<T>
+UniquePtr<T> MakeUniqueForOverwrite(size_t size) {
+    return UniquePtr<T>(new std::remove_extent_t<T>[size]);
+}
@@ -0,0 +1,186 @@
+#include "shared.h"
+
+#include <common/bench.h>
+
+#include <elf.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Release of the last reference to a `MakeShared` block with the manager table of `ControlBlock`
+// against the previous design, a control block with virtual `OnZeroShared`/`OnZeroWeak`, copied
+// below. The block sizes come out equal: the manager pointer takes the place of the vptr.
+//
+// Also compares the code and tables the block types leave in this binary: the symbols of both
+// designs, read from the ELF symbol table of the executable. Linux only, and only if the binary
+// is not stripped. The figure is only meaningful with optimizations (-O2): without inlining the
+// many small manager functions each get a symbol, and the manager design comes out larger.
+
+namespace {
+
+namespace with_vtable {
+
+template <typename Counter>
+class ControlBlock {
+public:
+    ControlBlock() : shared_cnt_(1), weak_cnt_(1) {
+    }
+    virtual ~ControlBlock() = default;
+
+    void DelShared() {
+        if (shared_cnt_.DecRef() == 0) {
+            OnZeroShared();
+            DelWeak();
+        }
+    }
+    void DelWeak() {
+        if (weak_cnt_.DecRef() == 0) {
+            OnZeroWeak();
+        }
+    }
+
+    virtual void OnZeroShared() = 0;
+    virtual void OnZeroWeak() = 0;
+    virtual void* GetObject() = 0;
+
+private:
+    Counter shared_cnt_;
+    Counter weak_cnt_;
+};
+
+template <typename T, typename Counter>
+class EmplacingControlBlock : public ControlBlock<Counter> {
+public:
+    template <typename... Args>
+    EmplacingControlBlock(Args&&... args) {
+        new (&buffer_) T(std::forward<Args>(args)...);
+    }
+
+    void OnZeroShared() override {
+        Get()->~T();
+    }
+    void OnZeroWeak() override {
+        delete this;
+    }
+    void* GetObject() override {
+        return Get();
+    }
+
+    T* Get() {
+        return reinterpret_cast<T*>(&buffer_);
+    }
+
+private:
+    alignas(T) std::byte buffer_[sizeof(T)];
+};
+
+}  // namespace with_vtable
+
+constexpr size_t kBatch = 1000;
+constexpr int kRounds = 2000;
+
+// Nanoseconds per `release` of a pointer made by `make`; only the releases are timed.
+template <typename Make, typename Release>
+double MeasureRelease(Make make, Release release) {
+    using Ptr = decltype(make());
+    // Not a `std::vector`: its instantiations would count as code of the blocks.
+    Ptr ptrs[kBatch];
+    std::chrono::nanoseconds total{0};
+    for (int round = 0; round < kRounds; ++round) {
+        for (auto& ptr : ptrs) {
+            ptr = make();
+        }
+        auto begin = std::chrono::steady_clock::now();
+        for (auto& ptr : ptrs) {
+            release(ptr);
+        }
+        total += std::chrono::steady_clock::now() - begin;
+    }
+    return static_cast<double>(total.count()) / (kBatch * kRounds);
+}
+
+template <typename T, typename Counter>
+void Report(const char* name, const T& value) {
+    using OldBlock = with_vtable::EmplacingControlBlock<T, Counter>;
+    using NewBlock = EmplacingControlBlock<T, Counter>;
+
+    double old_ns = MeasureRelease([&] { return new OldBlock(value); },
+                                   [](OldBlock* block) { block->DelShared(); });
+    double new_ns = MeasureRelease([&] { return new NewBlock(value); },
+                                   [](NewBlock* block) { block->DelShared(); });
+    std::printf("%-22s %12zu %12zu %14.2f %14.2f\n", name, sizeof(OldBlock), sizeof(NewBlock),
+                old_ns, new_ns);
+}
+
+struct CodeSize {
+    size_t vtable = 0;
+    size_t manager = 0;
+};
+
+// Sums the sizes of the symbols of both designs: the members of the block classes, their
+// vtables and type info, and the manager tables. Inlined code has no symbol and is not counted.
+bool MeasureCodeSize(CodeSize* size) {
+    std::ifstream file("/proc/self/exe", std::ios::binary);
+    std::vector<char> image{std::istreambuf_iterator<char>(file),
+                            std::istreambuf_iterator<char>()};
+    if (image.size() < sizeof(Elf64_Ehdr) || std::memcmp(image.data(), ELFMAG, SELFMAG) != 0 ||
+        image[EI_CLASS] != ELFCLASS64) {
+        return false;
+    }
+    auto header = reinterpret_cast<const Elf64_Ehdr*>(image.data());
+    auto sections = reinterpret_cast<const Elf64_Shdr*>(image.data() + header->e_shoff);
+    bool found = false;
+    for (size_t i = 0; i < header->e_shnum; ++i) {
+        if (sections[i].sh_type != SHT_SYMTAB) {
+            continue;
+        }
+        found = true;
+        const char* names = image.data() + sections[sections[i].sh_link].sh_offset;
+        auto symbols = reinterpret_cast<const Elf64_Sym*>(image.data() + sections[i].sh_offset);
+        for (size_t j = 0; j < sections[i].sh_size / sizeof(Elf64_Sym); ++j) {
+            std::string_view name = names + symbols[j].st_name;
+            for (std::string_view prefix : {"_ZTV", "_ZTI", "_ZTS", "_Z"}) {
+                if (name.starts_with(prefix)) {
+                    name.remove_prefix(prefix.size());
+                    break;
+                }
+            }
+            if (name.starts_with("N12_GLOBAL__N_111with_vtable")) {
+                size->vtable += symbols[j].st_size;
+            } else if (name.starts_with("N12ControlBlockI") ||
+                       name.starts_with("N21EmplacingControlBlockI")) {
+                size->manager += symbols[j].st_size;
+            }
+        }
+    }
+    return found;
+}
+
+}  // namespace
+
+int main() {
+    std::printf("%-22s %12s %12s %14s %14s\n", "object", "vtable (B)", "manager (B)",
+                "vtable (ns)", "manager (ns)");
+    Report<int, SimpleCounter>("int", 42);
+    Report<int, AtomicCounter>("int, atomic", 42);
+    Report<std::string, SimpleCounter>("std::string", std::string(64, 'a'));
+    Report<std::string, AtomicCounter>("std::string, atomic", std::string(64, 'a'));
+
+    CodeSize size;
+    if (MeasureCodeSize(&size)) {
+        std::printf("\ncode and tables of the blocks above, meaningful at -O2: vtable %zu B, "
+                    "manager %zu B\n",
+                    size.vtable, size.manager);
+    } else {
+        std::printf("\ncode size: no symbol table in the executable\n");
+    }
+}
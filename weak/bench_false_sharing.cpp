@@ -0,0 +1,83 @@
+#include "shared.h"
+
+#include <common/bench.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+// Half of the threads read the fields of a shared quote, the other half copy and drop
+// `SharedPtr`s to it, each thread pinned to its own core. With the default layout every copy
+// writes to the cache line holding the first fields of the quote; `IsolateCounters` moves the
+// quote to its own line.
+
+namespace {
+
+template <bool Isolated>
+struct Quote {
+    int64_t price = 100;
+    int64_t size = 10;
+};
+
+}  // namespace
+
+template <>
+struct IsolateCounters<Quote<true>> : std::true_type {};
+
+namespace {
+
+constexpr std::chrono::milliseconds kDuration{300};
+
+struct Result {
+    double reads;
+    double copies;
+};
+
+template <bool Isolated>
+Result Run(size_t num_threads) {
+    using Ptr = SharedPtr<Quote<Isolated>, AtomicCounter>;
+    Ptr quote = MakeShared<Quote<Isolated>, AtomicCounter>();
+    const Quote<Isolated>* fields = quote.Get();
+    std::atomic<uint64_t> reads = 0;
+    std::atomic<uint64_t> copies = 0;
+
+    double seconds = 1e-3 * kDuration.count();
+    MeasureThroughput(num_threads, kDuration, [&](size_t index, const std::atomic<bool>& stop) {
+        PinToCore(index);
+        uint64_t ops = 0;
+        if (index % 2 == 0) {
+            while (!stop.load(std::memory_order_relaxed)) {
+                DoNotOptimize(fields->price + fields->size);
+                ++ops;
+            }
+            reads += ops;
+        } else {
+            while (!stop.load(std::memory_order_relaxed)) {
+                Ptr copy = quote;
+                DoNotOptimize(copy.Get());
+                ++ops;
+            }
+            copies += ops;
+        }
+        return ops;
+    });
+    return {reads / seconds, copies / seconds};
+}
+
+}  // namespace
+
+int main() {
+    std::printf("%8s %20s %20s %20s %20s\n", "threads", "reads (Mops/s)", "isolated reads",
+                "copies (Mops/s)", "isolated copies");
+    for (size_t num_threads : ThreadCounts()) {
+        // A reader and a copier at least.
+        if (num_threads == 1 && std::thread::hardware_concurrency() > 1) {
+            continue;
+        }
+        num_threads = std::max<size_t>(num_threads, 2);
+        Result shared_line = Run<false>(num_threads);
+        Result isolated = Run<true>(num_threads);
+        std::printf("%8zu %20.2f %20.2f %20.2f %20.2f\n", num_threads, shared_line.reads / 1e6,
+                    isolated.reads / 1e6, shared_line.copies / 1e6, isolated.copies / 1e6);
+    }
+}
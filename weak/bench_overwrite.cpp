@@ -0,0 +1,64 @@
+#include "shared.h"
+
+#include <common/bench.h>
+#include <unique/unique.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+
+// Time from asking for a large buffer to having written its first byte: value-initializing
+// makers zero-fill every page, the `ForOverwrite` ones leave the pages untouched.
+
+namespace {
+
+constexpr int kRounds = 50;
+
+// `make()` returns a pointer to the buffer, `first_byte(buffer)` the byte to write. The
+// buffer is freed outside of the measurement.
+template <typename Make, typename FirstByte>
+double MicrosToFirstByte(Make make, FirstByte first_byte) {
+    std::chrono::duration<double, std::micro> total{0};
+    for (int round = 0; round < kRounds; ++round) {
+        auto begin = std::chrono::steady_clock::now();
+        auto buffer = make();
+        char& byte = first_byte(buffer);
+        byte = 1;
+        DoNotOptimize(byte);
+        total += std::chrono::steady_clock::now() - begin;
+    }
+    return total.count() / kRounds;
+}
+
+template <size_t Size>
+void Report() {
+    using Buffer = std::array<char, Size>;
+    auto object_byte = [](SharedPtr<Buffer>& buffer) -> char& { return (*buffer)[0]; };
+    auto array_byte = [](auto& buffer) -> char& { return buffer[0]; };
+
+    double object = MicrosToFirstByte([] { return MakeShared<Buffer>(); }, object_byte);
+    double object_overwrite =
+        MicrosToFirstByte([] { return MakeSharedForOverwrite<Buffer>(); }, object_byte);
+    double array = MicrosToFirstByte([] { return MakeShared<char[]>(Size); }, array_byte);
+    double array_overwrite =
+        MicrosToFirstByte([] { return MakeSharedForOverwrite<char[]>(Size); }, array_byte);
+    double unique = MicrosToFirstByte([] { return UniquePtr<char[]>(new char[Size]()); },
+                                      array_byte);
+    double unique_overwrite =
+        MicrosToFirstByte([] { return MakeUniqueForOverwrite<char[]>(Size); }, array_byte);
+
+    std::printf("%6zu MiB %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f\n", Size >> 20, object,
+                object_overwrite, array, array_overwrite, unique, unique_overwrite);
+}
+
+}  // namespace
+
+int main() {
+    std::printf("microseconds to the first written byte\n");
+    std::printf("%10s %12s %12s %12s %12s %12s %12s\n", "size", "object", "overwrite",
+                "T[]", "overwrite", "unique T[]", "overwrite");
+    Report<size_t{1} << 20>();
+    Report<size_t{16} << 20>();
+    Report<size_t{64} << 20>();
+}
@@ -0,0 +1,62 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <common/bench.h>
+
+#include <chrono>
+#include <cstdio>
+
+// Copy and destruction of `SharedPtr` with atomic counters. `TwoStepCounter` hides
+// `AtomicCounter::IsUnique`, so the last release always decrements the weak count as well:
+// the final release is compared with and without that second RMW.
+
+namespace {
+
+class TwoStepCounter : private AtomicCounter {
+public:
+    using AtomicCounter::AtomicCounter;
+    using AtomicCounter::DecRef;
+    using AtomicCounter::IncRef;
+    using AtomicCounter::IncRefIfNonZero;
+    using AtomicCounter::RefCount;
+};
+
+constexpr int kIters = 10'000'000;
+
+template <typename F>
+double NsPerOp(F body) {
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIters; ++i) {
+        body();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+    return elapsed.count() / kIters;
+}
+
+template <typename Counter>
+void Report(const char* name) {
+    auto ptr = MakeShared<int, Counter>(42);
+    double copy_ns = NsPerOp([&] {
+        SharedPtr<int, Counter> copy = ptr;
+        DoNotOptimize(copy.Get());
+    });
+    double last_ns = NsPerOp([] {
+        auto owner = MakeShared<int, Counter>(42);
+        DoNotOptimize(owner.Get());
+    });
+    WeakPtr<int, Counter> weak;
+    double last_weak_ns = NsPerOp([&] {
+        auto owner = MakeShared<int, Counter>(42);
+        weak = owner;
+    });
+    std::printf("%-16s %14.2f %18.2f %22.2f\n", name, copy_ns, last_ns, last_weak_ns);
+}
+
+}  // namespace
+
+int main() {
+    std::printf("%-16s %14s %18s %22s\n", "counter", "copy (ns)", "make+last (ns)",
+                "make+last+weak (ns)");
+    Report<AtomicCounter>("one RMW");
+    Report<TwoStepCounter>("two RMWs");
+}
@@ -2,9 +2,12 @@
 
 #include "sw_fwd.h"
 
-template <typename T>
+template <typename T, typename Counter>
 class SharedPtr {
 public:
+    // `U` for `SharedPtr<U[]>` and `SharedPtr<U[N]>`.
+    using ElementType = std::remove_extent_t<T>;
+
     SharedPtr() {
         block_ = nullptr;
         ptr_ = nullptr;
@@ -16,7 +19,7 @@ public:
 
     template <typename Y>
     SharedPtr(Y* ptr) {
-        block_ = new PointingControlBlock<Y>(ptr);
+        block_ = new PointingBlock<Y>(ptr);
         ptr_ = ptr;
     }
 
@@ -35,7 +38,7 @@ public:
     }
 
     template <typename Y>
-    SharedPtr(const SharedPtr<Y>& other) {
+    SharedPtr(const SharedPtr<Y, Counter>& other) {
         block_ = other.block_;
         ptr_ = other.ptr_;
         if (block_) {
@@ -43,14 +46,14 @@ public:
         }
     }
     template <typename Y>
-    SharedPtr(SharedPtr<Y>&& other) {
+    SharedPtr(SharedPtr<Y, Counter>&& other) {
         block_ = other.block_;
         ptr_ = other.ptr_;
         other.block_ = nullptr;
         other.ptr_ = nullptr;
     }
     template <typename Y>
-    SharedPtr(const SharedPtr<Y>& other, T* ptr) {
+    SharedPtr(const SharedPtr<Y, Counter>& other, ElementType* ptr) {
         block_ = other.block_;
         ptr_ = ptr;
         if (block_) {
@@ -58,15 +61,12 @@ public:
         }
     }
 
-    explicit SharedPtr(const WeakPtr<T>& other) {
-        if (other.Expired()) {
+    explicit SharedPtr(const WeakPtr<T, Counter>& other) {
+        if (!other.block_ || !other.block_->TryAddShared()) {
             throw BadWeakPtr();
         }
         block_ = other.block_;
         ptr_ = other.ptr_;
-        if (block_) {
-            block_->AddShared();
-        }
     }
 
     SharedPtr& operator=(const SharedPtr& other) {
@@ -94,7 +94,7 @@ public:
     }
 
     template <typename Y>
-    SharedPtr& operator=(const SharedPtr<Y>& other) {
+    SharedPtr& operator=(const SharedPtr<Y, Counter>& other) {
         Reset();
         block_ = other.block_;
         ptr_ = other.ptr_;
@@ -104,7 +104,7 @@ public:
         return *this;
     }
     template <typename Y>
-    SharedPtr& operator=(SharedPtr<Y>&& other) {
+    SharedPtr& operator=(SharedPtr<Y, Counter>&& other) {
         Reset();
         block_ = other.block_;
         ptr_ = other.ptr_;
@@ -130,7 +130,7 @@ public:
         if (block_) {
             block_->DelShared();
         }
-        block_ = new PointingControlBlock<Y>(ptr);
+        block_ = new PointingBlock<Y>(ptr);
         ptr_ = ptr;
     }
     void Swap(SharedPtr& other) {
@@ -138,15 +138,20 @@ public:
         std::swap(ptr_, other.ptr_);
     }
 
-    T* Get() const {
+    ElementType* Get() const {
         return ptr_;
     }
     T& operator*() const {
         return *ptr_;
     }
-    T* operator->() const {
+    ElementType* operator->() const {
         return ptr_;
     }
+    ElementType& operator[](size_t index) const
+        requires std::is_array_v<T>
+    {
+        return ptr_[index];
+    }
     size_t UseCount() const {
         if (!block_) {
             return 0;
@@ -157,41 +162,100 @@ public:
         return ptr_ != nullptr;
     }
 
-    template <typename Y, typename... Args>
-    friend SharedPtr<Y> MakeShared(Args&&... args);
+    template <typename Y, typename C, typename... Args>
+    friend SharedPtr<Y, C> MakeShared(Args&&... args);
+    template <typename Y, typename C, typename... Args>
+    friend SharedPtr<Y, C> MakeSharedForOverwrite(Args... size);
+    template <typename Y, typename C, typename Alloc, typename... Args>
+    friend SharedPtr<Y, C> AllocateShared(const Alloc& alloc, Args&&... args);
 
-    template <typename Y>
+    template <typename Y, typename C>
     friend class SharedPtr;
-    template <typename Y>
+    template <typename Y, typename C>
     friend class WeakPtr;
 
 private:
-    T* ptr_;
-    ControlBlock* block_;
+    // Block for a pointer from `new Y`, or from `new Y[size]` for `SharedPtr<U[]>`.
+    template <typename Y>
+    using PointingBlock =
+        PointingControlBlock<std::conditional_t<std::is_array_v<T>, Y[], Y>, Counter>;
+
+    ElementType* ptr_;
+    ControlBlock<Counter>* block_;
 };
 
-template <typename T, typename U>
-inline bool operator==(const SharedPtr<T>& left, const SharedPtr<U>& right) {
+template <typename T, typename U, typename Counter>
+inline bool operator==(const SharedPtr<T, Counter>& left, const SharedPtr<U, Counter>& right) {
     return left.Get() == right.Get();
 }
 
-template <typename T, typename... Args>
-SharedPtr<T> MakeShared(Args&&... args) {
-    SharedPtr<T> result;
-    EmplacingControlBlock<T>* emplacing_ptr =
-        new EmplacingControlBlock<T>(std::forward<Args>(args)...);
-    result.block_ = emplacing_ptr;
-    result.ptr_ = emplacing_ptr->Get();
+template <typename T, typename Counter = SimpleCounter, typename... Args>
+SharedPtr<T, Counter> MakeShared(Args&&... args) {
+    SharedPtr<T, Counter> result;
+    // `MakeShared<U[]>(size)` and `MakeShared<U[N]>()`: value-initialized elements.
+    if constexpr (std::is_array_v<T>) {
+        static_assert(sizeof...(Args) == (std::is_bounded_array_v<T> ? 0 : 1),
+                      "Arrays take their size and nothing else");
+        ArrayControlBlock<T, Counter>* block;
+        if constexpr (std::is_bounded_array_v<T>) {
+            block = ArrayControlBlock<T, Counter>::Create(std::extent_v<T>);
+        } else {
+            block = ArrayControlBlock<T, Counter>::Create(args...);
+        }
+        result.block_ = block;
+        result.ptr_ = block->Get();
+    } else {
+        EmplacingControlBlock<T, Counter>* emplacing_ptr =
+            new EmplacingControlBlock<T, Counter>(std::forward<Args>(args)...);
+        result.block_ = emplacing_ptr;
+        result.ptr_ = emplacing_ptr->Get();
+    }
+    return result;
+}
+
+// `MakeShared` that default-initializes the object or the elements: no zero-filling of buffers
+// about to be overwritten. Pages of large blocks are untouched until first written.
+template <typename T, typename Counter = SimpleCounter, typename... Args>
+SharedPtr<T, Counter> MakeSharedForOverwrite(Args... size) {
+    SharedPtr<T, Counter> result;
+    if constexpr (std::is_array_v<T>) {
+        static_assert(sizeof...(Args) == (std::is_bounded_array_v<T> ? 0 : 1),
+                      "Arrays take their size and nothing else");
+        ArrayControlBlock<T, Counter>* block;
+        if constexpr (std::is_bounded_array_v<T>) {
+            block = ArrayControlBlock<T, Counter>::Create(std::extent_v<T>, ForOverwriteTag{});
+        } else {
+            block = ArrayControlBlock<T, Counter>::Create(size..., ForOverwriteTag{});
+        }
+        result.block_ = block;
+        result.ptr_ = block->Get();
+    } else {
+        static_assert(sizeof...(Args) == 0, "Objects are built without arguments");
+        auto block = new EmplacingControlBlock<T, Counter>(ForOverwriteTag{});
+        result.block_ = block;
+        result.ptr_ = block->Get();
+    }
+    return result;
+}
+
+// `MakeShared` with the memory from `alloc`, which also frees it.
+template <typename T, typename Counter = SimpleCounter, typename Alloc, typename... Args>
+SharedPtr<T, Counter> AllocateShared(const Alloc& alloc, Args&&... args) {
+    SharedPtr<T, Counter> result;
+    auto block =
+        AllocatingControlBlock<T, Alloc, Counter>::Create(alloc, std::forward<Args>(args)...);
+    result.block_ = block;
+    result.ptr_ = block->Get();
     return result;
 }
 
 // Look for usage examples in tests
-template <typename T>
+template <typename T, typename Counter>
 class EnableSharedFromThis {
 public:
-    SharedPtr<T> SharedFromThis();
-    SharedPtr<const T> SharedFromThis() const;
+    SharedPtr<T, Counter> SharedFromThis();
+    SharedPtr<const T, Counter> SharedFromThis() const;
 
-    WeakPtr<T> WeakFromThis() noexcept;
-    WeakPtr<const T> WeakFromThis() const noexcept;
+    WeakPtr<T, Counter> WeakFromThis() noexcept;
+    WeakPtr<const T, Counter> WeakFromThis() const noexcept;
 };
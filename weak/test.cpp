@@ -175,3 +175,44 @@ TEST_CASE("Lifetimes") {
         delete wp;
     }
 }
+
+namespace {
+
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    CountingAllocator(int* live) : live(live) {
+    }
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>& other) : live(other.live) {
+    }
+
+    T* allocate(size_t n) {
+        ++*live;
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* ptr, size_t n) {
+        --*live;
+        std::allocator<T>().deallocate(ptr, n);
+    }
+
+    int* live;
+};
+
+}  // namespace
+
+TEST_CASE("AllocateShared block outlives the object") {
+    int live = 0;
+    WeakPtr<MyInt> wp;
+    {
+        auto sp = AllocateShared<MyInt>(CountingAllocator<MyInt>(&live));
+        wp = sp;
+        REQUIRE(live == 1);
+    }
+    REQUIRE(MyInt::AliveCount() == 0);
+    REQUIRE(wp.Expired());
+    REQUIRE(live == 1);
+    wp.Reset();
+    REQUIRE(live == 0);
+}
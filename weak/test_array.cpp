@@ -0,0 +1,135 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <catch.hpp>
+
+#include "allocations_checker.h"
+
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Records the order of destruction.
+struct Element {
+    Element() : index(next_index++) {
+    }
+    ~Element() {
+        destroyed.push_back(index);
+    }
+
+    int index;
+
+    inline static int next_index = 0;
+    inline static std::vector<int> destroyed;
+};
+
+struct Throwing {
+    Throwing() {
+        if (++constructed == 3) {
+            throw std::runtime_error("Throwing");
+        }
+    }
+    ~Throwing() {
+        ++destroyed;
+    }
+
+    inline static int constructed = 0;
+    inline static int destroyed = 0;
+};
+
+struct alignas(64) Aligned {
+    int value = 0;
+};
+
+}  // namespace
+
+TEST_CASE("MakeShared<T[]> makes one allocation") {
+    SharedPtr<int[]> ptr;
+    EXPECT_ONE_ALLOCATION(ptr = MakeShared<int[]>(100));
+    for (int i = 0; i < 100; ++i) {
+        REQUIRE(ptr[i] == 0);
+        ptr[i] = i;
+    }
+    auto copy = ptr;
+    REQUIRE(copy[99] == 99);
+    REQUIRE(copy.UseCount() == 2);
+
+    SharedPtr<std::string[4]> strings;
+    EXPECT_ONE_ALLOCATION(strings = MakeShared<std::string[4]>());
+    strings[3] = "abc";
+    REQUIRE(strings[3] == "abc");
+    REQUIRE(strings[0].empty());
+}
+
+TEST_CASE("Array elements are destroyed in reverse order") {
+    Element::next_index = 0;
+    Element::destroyed.clear();
+    MakeShared<Element[]>(5).Reset();
+    REQUIRE(Element::destroyed == std::vector<int>{4, 3, 2, 1, 0});
+
+    Element::next_index = 0;
+    Element::destroyed.clear();
+    MakeShared<Element[3]>().Reset();
+    REQUIRE(Element::destroyed == std::vector<int>{2, 1, 0});
+}
+
+TEST_CASE("Array construction failure destroys the built elements") {
+    REQUIRE_THROWS_AS(MakeShared<Throwing[]>(5), std::runtime_error);
+    REQUIRE(Throwing::destroyed == 2);
+}
+
+TEST_CASE("Array sizes whose allocation size overflows") {
+    REQUIRE_THROWS_AS(MakeShared<uint64_t[]>(SIZE_MAX / 8 + 2), std::bad_array_new_length);
+    REQUIRE_THROWS_AS(MakeShared<uint64_t[]>(SIZE_MAX), std::bad_array_new_length);
+    REQUIRE_THROWS_AS(MakeSharedForOverwrite<char[]>(SIZE_MAX - 1), std::bad_array_new_length);
+}
+
+TEST_CASE("WeakPtr to an array") {
+    WeakPtr<int[]> weak;
+    {
+        auto ptr = MakeShared<int[]>(3);
+        ptr[1] = 42;
+        weak = ptr;
+        REQUIRE(weak.Lock()[1] == 42);
+    }
+    REQUIRE(weak.Expired());
+    REQUIRE(!weak.Lock());
+}
+
+TEST_CASE("SharedPtr<T[]> owns new T[]") {
+    Element::destroyed.clear();
+    SharedPtr<Element[]> ptr(new Element[3]);
+    ptr.Reset();
+    REQUIRE(Element::destroyed.size() == 3);
+}
+
+TEST_CASE("Over-aligned array elements") {
+    auto ptr = MakeShared<Aligned[]>(4);
+    for (int i = 0; i < 4; ++i) {
+        REQUIRE(reinterpret_cast<uintptr_t>(&ptr[i]) % alignof(Aligned) == 0);
+    }
+}
+
+TEST_CASE("MakeSharedForOverwrite") {
+    SharedPtr<char[]> buffer;
+    EXPECT_ONE_ALLOCATION(buffer = MakeSharedForOverwrite<char[]>(1 << 20));
+    buffer[(1 << 20) - 1] = 'z';
+    REQUIRE(buffer[(1 << 20) - 1] == 'z');
+
+    Element::next_index = 0;
+    Element::destroyed.clear();
+    MakeSharedForOverwrite<Element[2]>().Reset();
+    REQUIRE(Element::destroyed == std::vector<int>{1, 0});
+
+    auto text = MakeSharedForOverwrite<std::string>();
+    REQUIRE(text->empty());
+    WeakPtr<std::string> weak(text);
+    text.Reset();
+    REQUIRE(weak.Expired());
+}
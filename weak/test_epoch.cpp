@@ -0,0 +1,109 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <common/epoch.h>
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Node {
+    explicit Node(int value) : value(value) {
+        ++alive;
+    }
+    ~Node() {
+        value = 0;
+        --alive;
+    }
+
+    int value;
+
+    inline static std::atomic<int> alive = 0;
+};
+
+using NodePtr = SharedPtr<Node, EpochCounter>;
+
+}  // namespace
+
+TEST_CASE("Epoch: object outlives the last pointer inside a guard") {
+    Node* raw;
+    {
+        EpochGuard guard;
+        NodePtr ptr = MakeShared<Node, EpochCounter>(1);
+        WeakPtr<Node, EpochCounter> weak(ptr);
+        raw = ptr.Get();
+        ptr.Reset();
+
+        REQUIRE(weak.Expired());
+        REQUIRE(!weak.Lock());
+        EpochDomain::Get().Collect();
+        REQUIRE(Node::alive == 1);
+        REQUIRE(raw->value == 1);
+    }
+    EpochDomain::Get().Collect();
+    REQUIRE(Node::alive == 0);
+}
+
+TEST_CASE("Epoch: guards nest") {
+    EpochGuard outer;
+    {
+        EpochGuard inner;
+        NodePtr ptr(new Node(2));
+    }
+    EpochDomain::Get().Collect();
+    REQUIRE(Node::alive == 1);
+}
+
+TEST_CASE("Epoch: limbo of an exited thread") {
+    EpochDomain::Get().Collect();
+    std::thread([] {
+        for (int i = 0; i < 10; ++i) {
+            MakeShared<Node, EpochCounter>(i);
+        }
+    }).join();
+    REQUIRE(Node::alive == 10);
+    EpochDomain::Get().Collect();
+    REQUIRE(Node::alive == 0);
+}
+
+TEST_CASE("Epoch: readers of raw pointers and a writer") {
+    constexpr size_t kNumReaders = 4;
+    constexpr int kNumVersions = 5000;
+
+    NodePtr current = MakeShared<Node, EpochCounter>(1);
+    std::atomic<Node*> published = current.Get();
+    std::atomic<bool> done = false;
+    std::atomic<bool> valid = true;
+
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < kNumReaders; ++i) {
+        readers.emplace_back([&] {
+            while (!done) {
+                EpochGuard guard;
+                if (published.load(std::memory_order_acquire)->value == 0) {
+                    valid = false;
+                }
+            }
+        });
+    }
+    for (int version = 2; version <= kNumVersions; ++version) {
+        NodePtr next = MakeShared<Node, EpochCounter>(version);
+        published.store(next.Get(), std::memory_order_release);
+        current = std::move(next);
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    REQUIRE(valid);
+
+    current.Reset();
+    EpochDomain::Get().Collect();
+    REQUIRE(Node::alive == 0);
+}
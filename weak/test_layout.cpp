@@ -0,0 +1,75 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <catch.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct alignas(64) Aligned {
+    int value = 0;
+};
+
+struct alignas(128) VeryAligned {
+    int value = 0;
+};
+
+struct Hot {
+    int64_t price = 0;
+    int64_t size = 0;
+};
+
+bool IsAligned(const void* ptr, size_t alignment) {
+    return reinterpret_cast<uintptr_t>(ptr) % alignment == 0;
+}
+
+template <typename Block>
+ptrdiff_t ObjectOffset(Block* block) {
+    return reinterpret_cast<std::byte*>(block->Get()) - reinterpret_cast<std::byte*>(block);
+}
+
+}  // namespace
+
+template <>
+struct IsolateCounters<Hot> : std::true_type {};
+
+TEST_CASE("MakeShared honours over-aligned types") {
+    for (int i = 0; i < 10; ++i) {
+        auto aligned = MakeShared<Aligned, AtomicCounter>();
+        REQUIRE(IsAligned(aligned.Get(), 64));
+        auto very_aligned = MakeShared<VeryAligned>();
+        REQUIRE(IsAligned(very_aligned.Get(), 128));
+        auto allocated = AllocateShared<Aligned>(std::allocator<Aligned>());
+        REQUIRE(IsAligned(allocated.Get(), 64));
+    }
+}
+
+TEST_CASE("Isolated counters are on another cache line") {
+    auto block = new EmplacingControlBlock<Hot, AtomicCounter>();
+    REQUIRE(IsAligned(block, 64));
+    REQUIRE(ObjectOffset(block) >= 64);
+    REQUIRE(sizeof(*block) % 64 == 0);
+    block->DelShared();
+
+    auto plain = new EmplacingControlBlock<Aligned, AtomicCounter>();
+    REQUIRE(ObjectOffset(plain) == 64);
+    plain->DelShared();
+
+    auto ptr = MakeShared<Hot, AtomicCounter>();
+    ptr->price = 100;
+    WeakPtr<Hot, AtomicCounter> weak(ptr);
+    REQUIRE(weak.Lock()->price == 100);
+}
+
+TEST_CASE("Bounded array blocks do not store their length") {
+    REQUIRE(sizeof(ArrayControlBlock<int[4]>) + sizeof(size_t) ==
+            sizeof(ArrayControlBlock<int[]>));
+    auto ptr = MakeShared<int[4]>();
+    ptr[3] = 1;
+    REQUIRE(ptr[3] == 1);
+}
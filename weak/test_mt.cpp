@@ -0,0 +1,225 @@
+#include "shared.h"
+#include "weak.h"
+
+#include <common/biased_counter.h>
+#include <common/packed_counter.h>
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Run under TSan to check the memory ordering of `AtomicCounter`, `PackedCounter` and
+// `BiasedCounter`.
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Tracked {
+    explicit Tracked(int value) : value(value) {
+        ++alive;
+    }
+    ~Tracked() {
+        value = 0;
+        --alive;
+    }
+
+    int value;
+
+    inline static std::atomic<int> alive = 0;
+};
+
+template <typename F>
+void RunThreads(size_t count, F func) {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < count; ++i) {
+        threads.emplace_back(func, i);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+constexpr size_t kNumThreads = 4;
+constexpr int kNumIters = 20000;
+
+}  // namespace
+
+TEMPLATE_TEST_CASE("Atomic counter has the same interface", "", AtomicCounter, PackedCounter) {
+    SharedPtr<int, TestType> a(new int(42));
+    auto b = MakeShared<int, TestType>(43);
+    WeakPtr<int, TestType> wa(a);
+    REQUIRE(a.UseCount() == 1);
+    REQUIRE(*wa.Lock() == 42);
+    a = b;
+    REQUIRE(wa.Expired());
+    REQUIRE(b.UseCount() == 2);
+    REQUIRE_THROWS_AS((SharedPtr<int, TestType>(wa)), BadWeakPtr);
+}
+
+TEMPLATE_TEST_CASE("Concurrent copies of one SharedPtr", "", AtomicCounter, PackedCounter) {
+    {
+        auto ptr = MakeShared<Tracked, TestType>(7);
+        std::atomic<int> bad_reads = 0;
+        RunThreads(kNumThreads, [&](size_t) {
+            for (int i = 0; i < kNumIters; ++i) {
+                SharedPtr<Tracked, TestType> copy = ptr;
+                SharedPtr<Tracked, TestType> another(copy);
+                if (another->value != 7) {
+                    ++bad_reads;
+                }
+            }
+        });
+        REQUIRE(bad_reads == 0);
+        REQUIRE(ptr.UseCount() == 1);
+        REQUIRE(Tracked::alive == 1);
+    }
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEMPLATE_TEST_CASE("Last owner races with other threads", "", AtomicCounter, PackedCounter) {
+    for (int round = 0; round < 200; ++round) {
+        SharedPtr<Tracked, TestType> ptr(new Tracked(round));
+        std::vector<SharedPtr<Tracked, TestType>> copies(kNumThreads, ptr);
+        std::atomic<int> bad_reads = 0;
+        ptr.Reset();
+        RunThreads(kNumThreads, [&](size_t index) {
+            if (copies[index]->value != round) {
+                ++bad_reads;
+            }
+            copies[index].Reset();
+        });
+        REQUIRE(bad_reads == 0);
+        REQUIRE(Tracked::alive == 0);
+    }
+}
+
+TEMPLATE_TEST_CASE("Lock races with the last Reset", "", AtomicCounter, PackedCounter) {
+    for (int round = 0; round < 200; ++round) {
+        auto ptr = MakeShared<Tracked, TestType>(round + 1);
+        WeakPtr<Tracked, TestType> weak(ptr);
+        std::atomic<int> bad_reads = 0;
+        std::atomic<bool> start = false;
+
+        std::thread owner([&] {
+            while (!start) {
+            }
+            ptr.Reset();
+        });
+        RunThreads(kNumThreads, [&](size_t) {
+            start = true;
+            for (int i = 0; i < 100; ++i) {
+                WeakPtr<Tracked, TestType> copy = weak;
+                if (auto locked = copy.Lock()) {
+                    if (locked->value != round + 1) {
+                        ++bad_reads;
+                    }
+                }
+            }
+        });
+        owner.join();
+
+        REQUIRE(bad_reads == 0);
+        REQUIRE(weak.Expired());
+        REQUIRE(!weak.Lock());
+        REQUIRE(Tracked::alive == 0);
+    }
+}
+
+TEST_CASE("Packed counter shrinks the block") {
+    REQUIRE(sizeof(EmplacingControlBlock<int, PackedCounter>) + 8 ==
+            sizeof(EmplacingControlBlock<int, AtomicCounter>));
+
+    auto ptr = MakeShared<Tracked, PackedCounter>(5);
+    WeakPtr<Tracked, PackedCounter> weak(ptr);
+    {
+        WeakPtr<Tracked, PackedCounter> another = weak;
+        REQUIRE(another.Lock()->value == 5);
+    }
+    ptr.Reset();
+    REQUIRE(Tracked::alive == 0);
+    REQUIRE(weak.Expired());
+    REQUIRE(!weak.Lock());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST_CASE("Biased counter on the owner thread") {
+    {
+        auto ptr = MakeShared<Tracked, BiasedCounter>(1);
+        WeakPtr<Tracked, BiasedCounter> weak(ptr);
+        std::vector<SharedPtr<Tracked, BiasedCounter>> copies(10, ptr);
+        REQUIRE(ptr.UseCount() == 11);
+        copies.clear();
+        REQUIRE(ptr.UseCount() == 1);
+        REQUIRE(weak.Lock()->value == 1);
+        ptr.Reset();
+        REQUIRE(weak.Expired());
+        REQUIRE(Tracked::alive == 0);
+    }
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("Biased pointer released by another thread") {
+    SharedPtr<Tracked, BiasedCounter> ptr(new Tracked(2));
+    auto copy = ptr;
+    std::thread([moved = std::move(copy)]() mutable { moved.Reset(); }).join();
+    REQUIRE(ptr.UseCount() == 1);
+
+    std::thread([moved = std::move(ptr)]() mutable { moved.Reset(); }).join();
+    // The owner still has the bias and destroys the object once it merges the queued counter.
+    REQUIRE(Tracked::alive == 1);
+    BiasedCounter::MergeQueued();
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("Biased pointer outlives its owner thread") {
+    SharedPtr<Tracked, BiasedCounter> ptr;
+    WeakPtr<Tracked, BiasedCounter> weak;
+    std::thread([&] {
+        ptr = MakeShared<Tracked, BiasedCounter>(3);
+        weak = ptr;
+        auto extra = ptr;
+        ptr = extra;
+    }).join();
+    REQUIRE(ptr.UseCount() == 1);
+    REQUIRE(weak.Lock()->value == 3);
+    ptr.Reset();
+    REQUIRE(weak.Expired());
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("Biased pointer copied by many threads") {
+    for (int round = 0; round < 50; ++round) {
+        auto ptr = MakeShared<Tracked, BiasedCounter>(round);
+        WeakPtr<Tracked, BiasedCounter> weak(ptr);
+        std::vector<SharedPtr<Tracked, BiasedCounter>> copies(kNumThreads, ptr);
+        std::atomic<int> bad_reads = 0;
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < kNumThreads; ++i) {
+            threads.emplace_back([&, mine = std::move(copies[i])]() mutable {
+                for (int j = 0; j < 1000; ++j) {
+                    SharedPtr<Tracked, BiasedCounter> copy = mine;
+                    if (copy->value != round || weak.Lock()->value != round) {
+                        ++bad_reads;
+                    }
+                }
+            });
+        }
+        for (int j = 0; j < 1000; ++j) {
+            SharedPtr<Tracked, BiasedCounter> copy = ptr;
+        }
+        ptr.Reset();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        BiasedCounter::MergeQueued();
+
+        REQUIRE(bad_reads == 0);
+        REQUIRE(weak.Expired());
+        REQUIRE(Tracked::alive == 0);
+    }
+}
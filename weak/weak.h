@@ -4,7 +4,7 @@
 #include "weak/shared.h"
 
 // https://en.cppreference.com/w/cpp/memory/weak_ptr
-template <typename T>
+template <typename T, typename Counter>
 class WeakPtr {
 public:
     WeakPtr() {
@@ -26,7 +26,7 @@ public:
         other.ptr_ = nullptr;
     }
 
-    WeakPtr(const SharedPtr<T>& other) {
+    WeakPtr(const SharedPtr<T, Counter>& other) {
         block_ = other.block_;
         ptr_ = other.ptr_;
         if (block_) {
@@ -83,27 +83,21 @@ public:
     bool Expired() const {
         return UseCount() == 0;
     }
-    SharedPtr<T> Lock() const {
-        SharedPtr<T> result;
-        if (Expired()) {
-            result.block_ = nullptr;
-            result.ptr_ = nullptr;
-            return result;
-        }
-        result.block_ = block_;
-        result.ptr_ = ptr_;
-        if (block_) {
-            block_->AddShared();
+    SharedPtr<T, Counter> Lock() const {
+        SharedPtr<T, Counter> result;
+        if (block_ && block_->TryAddShared()) {
+            result.block_ = block_;
+            result.ptr_ = ptr_;
         }
         return result;
     }
 
-    template <typename Y>
+    template <typename Y, typename C>
     friend class SharedPtr;
-    template <typename Y>
+    template <typename Y, typename C>
     friend class WeakPtr;
 
 private:
-    T* ptr_;
-    ControlBlock* block_;
+    std::remove_extent_t<T>* ptr_;
+    ControlBlock<Counter>* block_;
 };